@@ -1,9 +1,16 @@
 #ifndef _CORE_H_
 #define _CORE_H_
 #include <tuple>
+#include <cassert>
 #include <optional>
 #include <cstdint>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <array>
+#include <exception>
+#include <vector>
+#include <variant>
 
 template <typename... PatternPair>
 class PatternPairsRetType
@@ -26,6 +33,387 @@ public:
     using ValueT = Value const &;
 };
 
+// State of one match call, installed for the current thread while the call runs.
+// Projections of `app` patterns on the scrutinee are cached for the lifetime of the scope.
+class MatchScope
+{
+public:
+    template <typename Value>
+    explicit MatchScope(Value const &value)
+        : mEpoch{++counter()}
+        , mBegin{reinterpret_cast<char const *>(std::addressof(value))}
+        , mEnd{mBegin + sizeof(Value)}
+        , mPrevious{currentRef()}
+    {
+        currentRef() = this;
+    }
+    ~MatchScope()
+    {
+        currentRef() = mPrevious;
+    }
+    MatchScope(MatchScope const &) = delete;
+    MatchScope &operator=(MatchScope const &) = delete;
+
+    // Objects the scrutinee owns outside of itself, such as the elements of a vector or the values of a match on
+    // several values, counted as inside it while the part is alive. Only kept when bindings may refer to the owner.
+    // A part without an owner is a temporary whose user copies whatever refers to it before it goes away.
+    class Part
+    {
+    public:
+        Part(void const *owner, void const *begin, void const *end)
+            : Part{begin, end, currentRef() != nullptr && currentRef()->contains(owner),
+                   currentRef() != nullptr && currentRef()->mayReferTo(owner)}
+        {
+        }
+        Part(void const *begin, void const *end)
+            : Part{begin, end, false, currentRef() != nullptr}
+        {
+        }
+        ~Part()
+        {
+            if (mScope != nullptr)
+            {
+                mScope->mParts = mNext;
+            }
+        }
+        Part(Part const &) = delete;
+        Part &operator=(Part const &) = delete;
+
+    private:
+        friend class MatchScope;
+
+        Part(void const *begin, void const *end, bool lasting, bool linked)
+            : mScope{linked ? currentRef() : nullptr}
+            , mBegin{static_cast<char const *>(begin)}
+            , mEnd{static_cast<char const *>(end)}
+            , mLasting{lasting}
+        {
+            if (mScope != nullptr)
+            {
+                mNext = mScope->mParts;
+                mScope->mParts = this;
+            }
+        }
+
+        MatchScope const *const mScope;
+        char const *const mBegin;
+        char const *const mEnd;
+        bool const mLasting;
+        Part const *mNext = nullptr;
+    };
+
+    static MatchScope const *current()
+    {
+        return currentRef();
+    }
+    std::uint64_t epoch() const
+    {
+        return mEpoch;
+    }
+    // Whether the object lives inside the scrutinee, i.e. stays the same object during the whole call.
+    bool contains(void const *object) const
+    {
+        return find(static_cast<char const *>(object), true);
+    }
+    // Whether a binding may refer to the object: it is inside the scrutinee, or in a temporary part.
+    bool mayReferTo(void const *object) const
+    {
+        return find(static_cast<char const *>(object), false);
+    }
+
+private:
+    bool find(char const *address, bool lastingOnly) const
+    {
+        if (within(address, mBegin, mEnd))
+        {
+            return true;
+        }
+        for (Part const *part = mParts; part != nullptr; part = part->mNext)
+        {
+            if ((part->mLasting || !lastingOnly) && within(address, part->mBegin, part->mEnd))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    static bool within(char const *address, char const *begin, char const *end)
+    {
+        return std::less_equal<>{}(begin, address) && std::less<>{}(address, end);
+    }
+    static std::uint64_t &counter()
+    {
+        thread_local std::uint64_t count = 0;
+        return count;
+    }
+    static MatchScope const *&currentRef()
+    {
+        thread_local MatchScope const *scope = nullptr;
+        return scope;
+    }
+
+    std::uint64_t const mEpoch;
+    char const *const mBegin;
+    char const *const mEnd;
+    MatchScope const *const mPrevious;
+    mutable Part const *mParts = nullptr;
+};
+
+// Bindings of the identifiers of one match call, kept on the stack so that patterns are never written to
+// and a list of arms can be matched from several threads at once.
+// Each slot holds the binding of one identifier, found by the address the copies of that identifier share.
+class MatchFrame
+{
+public:
+    class Slot
+    {
+    public:
+        void const *key = nullptr;
+        void const *type = nullptr;
+        void *storage = nullptr;
+    };
+
+    MatchFrame(Slot *begin, Slot *end)
+        : mBegin{begin}
+        , mEnd{end}
+        , mPrevious{currentRef()}
+    {
+        currentRef() = this;
+    }
+    ~MatchFrame()
+    {
+        currentRef() = mPrevious;
+    }
+    MatchFrame(MatchFrame const &) = delete;
+    MatchFrame &operator=(MatchFrame const &) = delete;
+
+    static MatchFrame *current()
+    {
+        return currentRef();
+    }
+    // Gives the slots to the identifiers the function resets, i.e. those of the arms. No other key gets one later.
+    template <typename Reset>
+    void reserve(Reset const &reset)
+    {
+        mReserving = true;
+        reset();
+        mReserving = false;
+    }
+    // The slot of the key in this frame, or while reserving, a free slot of the given type which is then given to the key.
+    void *claim(void const *key, void const *type)
+    {
+        Slot *free = nullptr;
+        for (Slot *slot = mBegin; slot != mEnd; ++slot)
+        {
+            if (slot->key == key)
+            {
+                return slot->storage;
+            }
+            if (free == nullptr && slot->key == nullptr && slot->type == type)
+            {
+                free = slot;
+            }
+        }
+        if (free == nullptr || !mReserving)
+        {
+            return nullptr;
+        }
+        free->key = key;
+        return free->storage;
+    }
+    // The slot of the key in this frame or the closest enclosing frame having one.
+    void const *find(void const *key) const
+    {
+        for (MatchFrame const *frame = this; frame != nullptr; frame = frame->mPrevious)
+        {
+            for (Slot const *slot = frame->mBegin; slot != frame->mEnd; ++slot)
+            {
+                if (slot->key == key)
+                {
+                    return slot->storage;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static MatchFrame *&currentRef()
+    {
+        thread_local MatchFrame *frame = nullptr;
+        return frame;
+    }
+
+    Slot *const mBegin;
+    Slot *const mEnd;
+    MatchFrame *const mPrevious;
+    bool mReserving = false;
+};
+
+// The bindings made on the current thread since its outermost checkpoint, so that an alternative which fails undoes
+// the bindings it made, instead of every identifier of the pattern being reset before each attempt.
+class BindingTrail
+{
+public:
+    // A choice point: rollback() undoes the bindings made since it was set.
+    class Checkpoint
+    {
+    public:
+        Checkpoint()
+            : mMark{entries().size()}
+        {
+            ++depth();
+        }
+        ~Checkpoint()
+        {
+            if (--depth() == 0)
+            {
+                // Entries below the mark belong to checkpoints suspended by a barrier.
+                entries().resize(mMark);
+            }
+        }
+        Checkpoint(Checkpoint const &) = delete;
+        Checkpoint &operator=(Checkpoint const &) = delete;
+
+        void rollback() const
+        {
+            auto &trail = entries();
+            while (trail.size() > mMark)
+            {
+                trail.back().undo(trail.back().binding);
+                trail.pop_back();
+            }
+        }
+        // Makes the bindings made since the checkpoint own their values, before the values they refer to go away.
+        void materialize() const
+        {
+            auto &trail = entries();
+            for (std::size_t i = mMark; i < trail.size(); ++i)
+            {
+                trail[i].materialize(trail[i].binding);
+            }
+        }
+
+    protected:
+        std::size_t mark() const
+        {
+            return mMark;
+        }
+
+    private:
+        std::size_t const mMark;
+    };
+
+    // The checkpoint of selecting the arm of a match call. The bindings it made are kept for the handler but leave
+    // the trail when it ends, so that an enclosing checkpoint never undoes them once the frame holding them is gone.
+    class Scope : public Checkpoint
+    {
+    public:
+        ~Scope()
+        {
+            entries().resize(mark());
+        }
+    };
+
+    // Stops recording while a handler runs: its bindings belong to the handler, not to any enclosing checkpoint.
+    class Barrier
+    {
+    public:
+        Barrier()
+            : mDepth{depth()}
+        {
+            depth() = 0;
+        }
+        ~Barrier()
+        {
+            depth() = mDepth;
+        }
+        Barrier(Barrier const &) = delete;
+        Barrier &operator=(Barrier const &) = delete;
+
+    private:
+        std::size_t const mDepth;
+    };
+
+    // Bindings made outside of any checkpoint are never undone, so they are not recorded.
+    // Bindings other than plain pointers may refer to values they do not own yet, and provide materialize().
+    template <typename Binding>
+    static void record(Binding &binding)
+    {
+        if (depth() != 0)
+        {
+            entries().push_back(Entry{&binding, [](void *undone) { *static_cast<Binding *>(undone) = Binding{}; }, [](void *owner) {
+                                          if constexpr (!std::is_pointer_v<Binding>)
+                                          {
+                                              static_cast<Binding *>(owner)->materialize();
+                                          }
+                                      }});
+        }
+    }
+    // Runs the alternative, undoing its bindings when it fails.
+    template <typename Alternative>
+    static bool attempt(Alternative const &alternative)
+    {
+        Checkpoint const checkpoint;
+        if (alternative())
+        {
+            return true;
+        }
+        checkpoint.rollback();
+        return false;
+    }
+
+private:
+    class Entry
+    {
+    public:
+        void *binding;
+        void (*undo)(void *);
+        void (*materialize)(void *);
+    };
+
+    static std::vector<Entry> &entries()
+    {
+        thread_local std::vector<Entry> trail;
+        return trail;
+    }
+    static std::size_t &depth()
+    {
+        thread_local std::size_t count = 0;
+        return count;
+    }
+};
+
+// Storage for the bindings of the identifiers used by the arms, defined in patterns.h.
+template <typename Arms>
+class BindingFrame;
+
+// Selects the first matching arm, defined in patterns.h.
+template <typename Value, typename Arms, typename Enable = void>
+class ArmsMatchHelper;
+
+// What the arm selection can compute once per list of arms, kept by a Matcher, defined in patterns.h.
+template <typename Arms>
+class ArmsState;
+
+// The index of the first matching arm, using the state when given one, defined in patterns.h.
+template <typename Value, typename Arms, typename State>
+std::size_t firstMatchOf(Value const &value, Arms const &arms, State const *state);
+
+// Whether the arms are known at compile time to match every value, defined in patterns.h.
+template <typename Value, typename Arms>
+class Exhaustiveness;
+
+template <typename Value>
+class IsStdVariant : public std::false_type
+{
+};
+
+template <typename... Ts>
+class IsStdVariant<std::variant<Ts...> > : public std::true_type
+{
+};
+
 template <typename Value, bool byRef>
 class MatchHelper
 {
@@ -37,22 +425,105 @@ public:
     template <typename... PatternPair>
     auto operator()(PatternPair const &...patterns)
     {
-        using RetType = typename PatternPairsRetType<PatternPair...>::RetType;
-        RetType result{};
-        auto const func = [this, &result](auto const &pattern) -> bool {
-            if (pattern.matchValue(mValue))
-            {
-                result = pattern.execute();
-                return true;
-            }
-            return false;
-        };
-        bool const matched = (func(patterns) || ...);
-        assert(matched);
-        return result;
+        return run(static_cast<ArmsState<std::tuple<PatternPair...> > const *>(nullptr), patterns...);
+    }
+    // Same as operator(), with what the arms allow computing ahead, for arms matched many times.
+    template <typename... PatternPair>
+    auto prepared(ArmsState<std::tuple<PatternPair...> > const &state, PatternPair const &...patterns)
+    {
+        return run(&state, patterns...);
+    }
+    // Same as operator(), but fails to compile unless the arms are known to match every value.
+    template <typename... PatternPair>
+    auto exhaustive(PatternPair const &...patterns)
+    {
+        static_assert(Exhaustiveness<Value, std::tuple<PatternPair...> >::value, "Patterns are not exhaustive.");
+        return (*this)(patterns...);
     }
 
 private:
+    template <typename... PatternPair>
+    auto run(ArmsState<std::tuple<PatternPair...> > const *state, PatternPair const &...patterns)
+    {
+        using RetType = typename PatternPairsRetType<PatternPair...>::RetType;
+        BindingFrame<std::tuple<PatternPair...> > frame{patterns...};
+        auto const arms = std::forward_as_tuple(patterns...);
+        // The scopes end before the handler runs, which may change the scrutinee and match it again.
+        std::size_t const index = [&] {
+            MatchScope const scope{mValue};
+            [[maybe_unused]] auto const parts = scrutineeParts();
+            [[maybe_unused]] typename BindingFrame<std::tuple<PatternPair...> >::Trail const trail;
+            return firstMatchOf<Value>(mValue, arms, state);
+        }();
+        constexpr bool exhaustive = Exhaustiveness<Value, std::tuple<PatternPair...> >::value;
+        if constexpr (!exhaustive)
+        {
+            assert(index < sizeof...(PatternPair));
+        }
+        // The result is built directly from the handler's return value, no default construction.
+        static constexpr auto executeArms = makeExecuteArms<RetType, decltype(arms), exhaustive>(std::index_sequence_for<PatternPair...>{});
+        BindingTrail::Barrier const barrier;
+        return executeArms[index](arms);
+    }
+    // The values of a match on several values are referred to by mValue, and last as long as it.
+    auto scrutineeParts() const
+    {
+        if constexpr (byRef)
+        {
+            return std::tuple<>{};
+        }
+        else
+        {
+            return std::apply(
+                [this](auto const &...values) {
+                    return std::array<MatchScope::Part, sizeof...(values)>{
+                        MatchScope::Part{&mValue, std::addressof(values), std::addressof(values) + 1}...};
+                },
+                mValue);
+        }
+    }
+    // One entry per arm, plus one for the case no arm matched.
+    // Exhaustive arms still miss a variant left valueless by an exception, which is reported as std::visit does.
+    template <typename RetType, typename Arms, bool exhaustive, std::size_t... I>
+    static constexpr auto makeExecuteArms(std::index_sequence<I...>)
+    {
+        using Execute = RetType (*)(Arms const &);
+        if constexpr (exhaustive && IsStdVariant<std::decay_t<Value> >::value)
+        {
+            return std::array<Execute, sizeof...(I) + 1>{executeArm<RetType, I, Arms>..., valueless<RetType, Arms>};
+        }
+        else
+        {
+            return std::array<Execute, sizeof...(I) + 1>{executeArm<RetType, I, Arms>..., noMatch<RetType, Arms>};
+        }
+    }
+    template <typename RetType, std::size_t I, typename Arms>
+    static RetType executeArm(Arms const &arms)
+    {
+        return std::get<I>(arms).execute();
+    }
+    template <typename RetType, typename Arms>
+    [[noreturn]] static RetType valueless(Arms const &)
+    {
+#if defined(__cpp_exceptions)
+        throw std::bad_variant_access{};
+#else
+        std::terminate();
+#endif
+    }
+    template <typename RetType, typename Arms>
+    static RetType noMatch(Arms const &)
+    {
+        if constexpr (std::is_default_constructible_v<RetType> || std::is_void_v<RetType>)
+        {
+            return RetType();
+        }
+        else
+        {
+            std::terminate();
+        }
+    }
+
     typename ValueType<Value, byRef>::ValueT mValue;
 };
 
@@ -68,4 +539,30 @@ auto match(First const &first, Values const &...values)
     auto const x = std::forward_as_tuple(first, values...);
     return MatchHelper<decltype(x), false>{x};
 }
+// A list of arms built once and matched against many values.
+template <typename... PatternPair>
+class Matcher
+{
+public:
+    explicit Matcher(PatternPair const &...patterns)
+        : mPatterns{patterns...}
+        , mState{mPatterns}
+    {
+    }
+    template <typename... Values>
+    auto operator()(Values const &...values) const
+    {
+        return std::apply([this, &values...](auto const &...patterns) { return match(values...).prepared(mState, patterns...); }, mPatterns);
+    }
+
+private:
+    std::tuple<PatternPair...> mPatterns;
+    ArmsState<std::tuple<PatternPair...> > mState;
+};
+
+template <typename... PatternPair>
+auto matcher(PatternPair const &...patterns)
+{
+    return Matcher<PatternPair...>{patterns...};
+}
 #endif // _CORE_H_
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <variant>
 #include <array>
 #include <any>
+#include <thread>
+#include <vector>
+#include <string_view>
 
 template <typename V, typename U>
 void compare(V const &result, U const &expected)
@@ -60,7 +63,7 @@ void test1()
     testMatch(2, 12, matchFunc);
     testMatch(11, 121, matchFunc);   // Id matched.
     testMatch(59, 12, matchFunc);    // or_ matched.
-    testMatch(-5, -1, matchFunc);    // meet matched.
+    testMatch(-5, -1, matchFunc);    // _ < 0 matched.
     testMatch(10, 100, matchFunc);   // app matched.
     testMatch(100, 1000, matchFunc); // app > meet matched.
     testMatch(5, -10, matchFunc);    // _ < 10 matched.
@@ -166,8 +169,9 @@ bool operator==(Two const &, Two const &)
 template <Kind k>
 auto const kind = app(&Num::kind, k);
 
+// Returns a reference when T is one, so that identifiers bound to the result refer to the original.
 template <typename T>
-auto const cast = [](auto && input){
+auto const cast = [](auto && input) -> T {
     return static_cast<T>(input);
 }; 
 
@@ -527,9 +531,11 @@ void test19()
     {
         Id<int> i;
         compare(matchPattern(std::make_tuple(3, 2, 2, 3, 3), ds(ooo(i), ooo(2), ooo(i))), true);
-        // Id<int> n;
-        // TODO, match on segment variable length with oon(pat, n)
-        // compare(matchPattern(std::make_tuple(3, 2, 2, 3, 3), ds(oon(3, n), ooo(2), oon(3, n))), true);
+        Id<std::size_t> n;
+        compare(matchPattern(std::make_tuple(3, 3, 2, 3, 3), ds(oon(3, n), ooo(2), oon(3, n))), true);
+        compare(*n, std::size_t{2});
+        Id<std::size_t> m;
+        compare(matchPattern(std::make_tuple(3, 2, 2, 3, 3), ds(oon(3, m), ooo(2), oon(3, m))), false);
     }
 }
 
@@ -537,10 +543,7 @@ void test20()
 {
     auto const matchFunc = [](auto &&input) {
         Id<char> x;
-        // Id<int> i;
-        int i = 2;
         return match(input)(
-            // why this one fail to match?
             pattern(
                 ds('+', ooo(_), 1, ds('^', ds('s', x), 2))) = [] { return 9; },
             pattern(
@@ -591,6 +594,7 @@ void test20()
                 std::make_tuple('+', 1, std::make_tuple('^', std::make_tuple('s', y), 2)),
                 ds('+', 1, ds('^', ds('s', x), 2))),
             true);
+    testMatch(std::make_tuple('+', 1, std::make_tuple('^', std::make_tuple('s', y), 2)), 9, matchFunc);
     static_assert(MatchFuncDefinedV<std::tuple<std::tuple<char, char>, int>, Ds<Ds<char, Id<char, true> >, int> >);
     static_assert(MatchFuncDefinedV<std::tuple<std::string, std::tuple<char, char>, int>, Ds<std::string, Ds<char, Id<char, true> >, int> >);
     static_assert(MatchFuncDefinedV<std::tuple<bool, std::tuple<char, char>, int>, Ds<bool, Ds<char, Id<char, true> >, int> >);
@@ -618,6 +622,886 @@ void test21()
     assert(drop<0>(A) == A);
 }
 
+void test22()
+{
+    auto const matchFunc = [](auto &&input) {
+        Id<int> i;
+        return match(input)(
+            pattern(ds('/', 1, 1)) = [] { return 1; },
+            pattern(ds('/', 0, _)) = [] { return 0; },
+            pattern(ds('/', i, i)) = [&i] { return 100 + *i; },
+            pattern(ds('*', _ > 5, 2)) = [] { return 2; },
+            pattern(ds('*', i, 2)) = [&i] { return *i * 2; },
+            pattern(or_(ds('+', 1, 1), ds('+', 2, 2))) = [] { return -2; },
+            pattern(ds('+', i, _)).when([&i] { return *i > 10; }) = [&i] { return *i; },
+            pattern(_) = [] { return -1; });
+    };
+    testMatch(std::make_tuple('/', 1, 1), 1, matchFunc);
+    testMatch(std::make_tuple('/', 0, 3), 0, matchFunc);
+    testMatch(std::make_tuple('/', 3, 3), 103, matchFunc);
+    testMatch(std::make_tuple('/', 3, 4), -1, matchFunc);
+    testMatch(std::make_tuple('*', 7, 2), 2, matchFunc);
+    testMatch(std::make_tuple('*', 4, 2), 8, matchFunc);
+    testMatch(std::make_tuple('*', 4, 3), -1, matchFunc);
+    testMatch(std::make_tuple('+', 11, 3), 11, matchFunc);
+    testMatch(std::make_tuple('+', 9, 3), -1, matchFunc);
+    testMatch(std::make_tuple('+', 2, 2), -2, matchFunc);
+
+    // An arm whose literal column fails is dropped before its other columns are tried.
+    int calls = 0;
+    auto const counted = meet([&calls](int) { return ++calls > 0; });
+    auto const rows = [&counted](auto &&input) {
+        return match(input)(
+            pattern(ds(counted, 1)) = [] { return 1; },
+            pattern(ds(counted, 2)) = [] { return 2; },
+            pattern(ds(counted, 3)) = [] { return 3; },
+            pattern(_) = [] { return -1; });
+    };
+    testMatch(std::make_tuple(0, 3), 3, rows);
+    compare(calls, 1);
+}
+
+void test23()
+{
+    auto const opcode = [](auto const &op) {
+        return match(op)(
+            pattern(0x01) = [] { return 1; },
+            pattern(or_(0x02, 0x03)) = [] { return 2; },
+            pattern(_ > 0x40) = [] { return 3; },
+            pattern(or_(0x04, 0x05, 0x06, 0x41)) = [] { return 4; },
+            pattern(-1) = [] { return 5; },
+            pattern(0x07) = [] { return 6; },
+            pattern(_) = [] { return 7; });
+    };
+    testMatch(0x01, 1, opcode);
+    testMatch(0x03, 2, opcode);
+    testMatch(0x41, 3, opcode);
+    testMatch(0x05, 4, opcode);
+    testMatch(-1, 5, opcode);
+    testMatch(0x07, 6, opcode);
+    testMatch(0x08, 7, opcode);
+    testMatch(static_cast<uint8_t>(0x06), 4, opcode);
+    testMatch(static_cast<uint8_t>(0xff), 3, opcode);
+    testMatch(static_cast<int16_t>(-1), 5, opcode);
+
+    static auto const opcodeX = matcher(
+        pattern(0x01) = [] { return 1; },
+        pattern(or_(0x02, 0x03)) = [] { return 2; },
+        pattern(_ > 0x40) = [] { return 3; },
+        pattern(or_(0x04, 0x05, 0x06, 0x41)) = [] { return 4; },
+        pattern(_) = [] { return 7; });
+    testMatch(0x03, 2, opcodeX);
+    testMatch(0x41, 3, opcodeX);
+    testMatch(0x06, 4, opcodeX);
+    testMatch(0x08, 7, opcodeX);
+
+    auto const nested = [](auto const &op) {
+        return match(op)(
+            pattern(or_(or_(1, 2), 3)) = [] { return 1; },
+            pattern(4) = [] { return 2; },
+            pattern(5) = [] { return 3; },
+            pattern(or_(or_(6, 7), or_(8, 9))) = [] { return 4; },
+            pattern(_) = [] { return 5; });
+    };
+    testMatch(1, 1, nested);
+    testMatch(3, 1, nested);
+    testMatch(5, 3, nested);
+    testMatch(7, 4, nested);
+    testMatch(8, 4, nested);
+    testMatch(9, 4, nested);
+    testMatch(10, 5, nested);
+}
+
+void test24()
+{
+    auto const bucket = [](auto const &rate) {
+        return match(rate)(
+            pattern(_ < 0) = [] { return -1; },
+            pattern(0) = [] { return 0; },
+            pattern(_ <= 10) = [] { return 1; },
+            pattern(and_(_ > 10, _ < 100)) = [] { return 2; },
+            pattern(between(100, 200)) = [] { return 3; },
+            pattern(and_(_ >= 150, _ <= 1000)) = [] { return 4; },
+            pattern(_) = [] { return 5; });
+    };
+    testMatch(-3, -1, bucket);
+    testMatch(0, 0, bucket);
+    testMatch(10, 1, bucket);
+    testMatch(11, 2, bucket);
+    testMatch(100, 3, bucket);
+    testMatch(200, 3, bucket);
+    testMatch(201, 4, bucket);
+    testMatch(1001, 5, bucket);
+    testMatch(-0.5, -1, bucket);
+    testMatch(10.5, 2, bucket);
+    testMatch(200.5, 4, bucket);
+    testMatch(std::numeric_limits<double>::quiet_NaN(), 5, bucket);
+    compare(matchPattern(5, between(1, 5)), true);
+    compare(matchPattern(6, between(1, 5)), false);
+}
+
+class CountedTwo : public Two
+{
+public:
+    Kind kind() const override
+    {
+        ++calls;
+        return Two::kind();
+    }
+    inline static int calls = 0;
+};
+
+void test25()
+{
+    auto const matchFunc = [](Num const &input) {
+        RefId<One> one;
+        return match(input)(
+            pattern(as<One, Kind::kONE>(one)) = [&one] { return one.value().get(); },
+            pattern(and_(kind<Kind::kONE>, _)) = [] { return 0; },
+            pattern(kind<Kind::kTWO>) = [] { return 2; },
+            pattern(_) = [] { return 3; });
+    };
+    testMatch(CountedTwo{}, 2, matchFunc);
+    compare(CountedTwo::calls, 1);
+    testMatch(CountedTwo{}, 2, matchFunc);
+    compare(CountedTwo::calls, 2);
+    CountedTwo two;
+    compare(matchPattern(two, kind<Kind::kTWO>) && matchPattern(two, kind<Kind::kTWO>), true);
+    compare(CountedTwo::calls, 4);
+
+    // A handler changing the scrutinee and matching it again sees the new projection.
+    std::pair<int, int> counter{0, 0};
+    auto const first = [](std::pair<int, int> const &p) { return p.first; };
+    auto const result = match(counter)(
+        pattern(app(first, 0)) = [&counter, first] {
+            counter.first = 1;
+            return matchPattern(counter, app(first, 1));
+        },
+        pattern(_) = [] { return false; });
+    compare(result, true);
+}
+
+void test26()
+{
+    auto const altX = [](auto const &v) {
+        Id<int> i;
+        Id<std::string> s;
+        return match(v)(
+            pattern(alt<int>(0)) = [] { return std::string("zero"); },
+            pattern(alt<int>(i)) = [&i] { return std::to_string(*i); },
+            pattern(alt<std::string>(s)) = [&s] { return *s; },
+            pattern(alt<Circle>(_)) = [] { return std::string("Circle"); },
+            pattern(_) = [] { return std::string("other"); });
+    };
+    std::variant<int, std::string, Circle, Square> v;
+    testMatch(v, "zero", altX);
+    v = 5;
+    testMatch(v, "5", altX);
+    v = std::string("str");
+    testMatch(v, "str", altX);
+    v = Circle{};
+    testMatch(v, "Circle", altX);
+    v = Square{};
+    testMatch(v, "other", altX);
+    compare(matchPattern(v, alt<Square>(_)), true);
+    compare(matchPattern(v, alt<Circle>(_)), false);
+}
+
+struct Ring : Circle
+{
+    int width = 2;
+};
+
+void test27()
+{
+    auto const shape = [](Shape const &s) {
+        return match(s)(
+            pattern(dyn<Ring>(app(&Ring::width, 1))) = [] { return std::string("Thin Ring"); },
+            pattern(dyn<Circle>(_)) = [] { return std::string("Circle"); },
+            pattern(dyn<Ring>(_)) = [] { return std::string("Ring"); },
+            pattern(dyn<Square>(_)) = [] { return std::string("Square"); },
+            pattern(_) = [] { return std::string("Shape"); });
+    };
+    for (auto i = 0; i < 2; ++i)
+    {
+        testMatch(Square{}, "Square", shape);
+        testMatch(Circle{}, "Circle", shape);
+        testMatch(Ring{}, "Circle", shape);
+        Ring thin;
+        thin.width = 1;
+        testMatch(thin, "Thin Ring", shape);
+        testMatch(Shape{}, "Shape", shape);
+    }
+    compare(matchPattern(Ring{}, dyn<Circle>(_)), true);
+    compare(matchPattern(Circle{}, dyn<Ring>(_)), false);
+}
+
+void test28()
+{
+    auto const anyX = [](std::any const &a) {
+        Id<int> i;
+        return match(a)(
+            pattern(alt<int>(0)) = [] { return std::string("zero"); },
+            pattern(alt<int>(i)) = [&i] { return std::to_string(*i); },
+            pattern(alt<std::string>(_)) = [] { return std::string("string"); },
+            pattern(alt<Square>(_)) = [] { return std::string("Square"); },
+            pattern(alt<Circle>(_)) = [] { return std::string("Circle"); },
+            pattern(_) = [] { return std::string("other"); });
+    };
+    testMatch(std::any{0}, "zero", anyX);
+    testMatch(std::any{7}, "7", anyX);
+    testMatch(std::any{std::string("str")}, "string", anyX);
+    testMatch(std::any{Square{}}, "Square", anyX);
+    testMatch(std::any{Circle{}}, "Circle", anyX);
+    testMatch(std::any{1.5}, "other", anyX);
+    testMatch(std::any{}, "other", anyX);
+    compare(matchPattern(std::any{Circle{}}, alt<Circle>(_)), true);
+    compare(matchPattern(std::any{Circle{}}, alt<Square>(_)), false);
+}
+
+void test29()
+{
+    static_assert(isIrrefutableV<std::tuple<int, char>, Ds<Id<int>, WildCard> >);
+    static_assert(HasRepeatedTypes<IdsOf<Ds<Id<int>, Ds<char, Id<int> > > >::type>::value);
+    static_assert(!HasRepeatedTypes<IdsOf<Ds<Id<int>, Ds<char, Id<char> > > >::type>::value);
+    static_assert(!isIrrefutableV<std::tuple<int, char>, Ds<Id<int>, char> >);
+    static_assert(!isIrrefutableV<std::tuple<int, char, int>, Ds<Id<int>, WildCard> >);
+    static_assert(isIrrefutableV<std::tuple<int, char, int>, Ds<WildCard, Ooo<WildCard> > >);
+    static_assert(isIrrefutableV<int, Or<int, WildCard> >);
+    static_assert(!isIrrefutableV<int, And<int, WildCard> >);
+    static_assert(isIrrefutableV<std::variant<int, char>, Or<Alt<int, WildCard>, Alt<char, Id<char> > > >);
+    static_assert(!isIrrefutableV<std::variant<int, char>, Alt<int, WildCard> >);
+
+    auto const exhaustiveX = [](auto const &v) {
+        Id<int> i;
+        return match(v).exhaustive(
+            pattern(alt<int>(0)) = [] { return 0; },
+            pattern(alt<int>(i)) = [&i] { return *i; },
+            pattern(alt<char>(_)) = [] { return -1; });
+    };
+    testMatch(std::variant<int, char>{0}, 0, exhaustiveX);
+    testMatch(std::variant<int, char>{5}, 5, exhaustiveX);
+    testMatch(std::variant<int, char>{'c'}, -1, exhaustiveX);
+
+    auto const pairX = [](auto const &x) {
+        Id<int> i;
+        return match(x).exhaustive(
+            pattern(1, _) = [] { return 1; },
+            pattern(i, _) = [&i] { return *i; });
+    };
+    testMatch(std::make_pair(1, 'a'), 1, pairX);
+    testMatch(std::make_pair(3, 'a'), 3, pairX);
+}
+
+struct Meters
+{
+    explicit Meters(int v) : value{v} {}
+    int value;
+    bool operator==(Meters const &other) const { return value == other.value; }
+};
+
+#if defined(__cpp_exceptions)
+// Throws when copied, leaving a variant it is emplaced into valueless.
+struct Boom
+{
+    Boom() = default;
+    Boom(Boom const &) { throw 1; }
+    Boom &operator=(Boom const &) = default;
+};
+#endif
+
+void test30()
+{
+    auto const metersX = [](auto const &x) {
+        Id<int> i;
+        return match(x).exhaustive(
+            pattern(0) = [] { return Meters{0}; },
+            pattern(i) = [&i] { return Meters{*i * 1000}; });
+    };
+    testMatch(0, Meters{0}, metersX);
+    testMatch(3, Meters{3000}, metersX);
+
+    auto const nameX = [](auto const &x) {
+        return match(x)(
+            pattern(1) = [] { return std::string{"one"}; },
+            pattern(_) = [] { return std::string{"many"}; });
+    };
+    testMatch(1, std::string{"one"}, nameX);
+    testMatch(7, std::string{"many"}, nameX);
+
+#if defined(__cpp_exceptions)
+    // Arms covering every alternative still meet a variant left valueless by an exception.
+    std::variant<int, Boom> boom;
+    try
+    {
+        boom.emplace<Boom>(Boom{});
+    }
+    catch (int)
+    {
+    }
+    bool thrown = false;
+    try
+    {
+        match(boom).exhaustive(
+            pattern(alt<int>(_)) = [] { return Meters{1}; },
+            pattern(alt<Boom>(_)) = [] { return Meters{2}; });
+    }
+    catch (std::bad_variant_access const &)
+    {
+        thrown = true;
+    }
+    compare(boom.valueless_by_exception() && thrown, true);
+#endif
+}
+
+void test31()
+{
+    static auto const fib = [] {
+        Id<int> i;
+        return matcher(
+            pattern(_ < 0) = [] { return -1; },
+            pattern(or_(0, 1)) = [] { return 1; },
+            pattern(i) = [i] { return *i * 10; });
+    }();
+    testMatch(-3, -1, fib);
+    testMatch(1, 1, fib);
+    testMatch(7, 70, fib);
+    testMatch(8, 80, fib);
+
+    auto const pairX = [] {
+        Id<int> i;
+        return matcher(
+            pattern(i, i) = [] { return std::string{"same"}; },
+            pattern(_, _) = [] { return std::string{"different"}; });
+    }();
+    compare(pairX(2, 2), std::string{"same"});
+    compare(pairX(2, 3), std::string{"different"});
+    compare(pairX(3, 3), std::string{"same"});
+}
+
+void test32()
+{
+    static auto const metersX = [] {
+        Id<Meters> m;
+        return matcher(
+            pattern(ds(m, m)) = [m] { return (*m).value; },
+            pattern(_) = [] { return -1; });
+    }();
+    testMatch(std::make_tuple(Meters{2}, Meters{2}), 2, metersX);
+    testMatch(std::make_tuple(Meters{3}, Meters{3}), 3, metersX);
+    testMatch(std::make_tuple(Meters{3}, Meters{4}), -1, metersX);
+
+    auto const value = std::make_pair(std::string{"one"}, 1);
+    RefId<std::string> s;
+    compare(matchPattern(value, ds(s, 1)), true);
+    compare(&*s, &value.first);
+}
+
+void test33()
+{
+    static auto const sumX = [] {
+        Id<int> i;
+        Id<int> j;
+        return matcher(
+            pattern(i, i) = [i] { return *i * 2; },
+            pattern(i, j) = [i, j] { return *i + *j; });
+    }();
+    std::array<int, 4> failures{};
+    std::array<std::thread, 4> threads;
+    for (std::size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t] = std::thread([t, &failures] {
+            for (int n = 0; n < 10000; ++n)
+            {
+                int const x = static_cast<int>(t) * 100000 + n;
+                failures[t] += sumX(x, x) != x * 2;
+                failures[t] += sumX(x, 1) != x + 1;
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    compare(failures, std::array<int, 4>{});
+
+    Id<int> i;
+    auto const nested = match(1)(
+        pattern(i) = [&i] {
+            auto const inner = match(2)(pattern(i) = [&i] { return *i; });
+            return *i * 10 + inner;
+        });
+    compare(nested, 12);
+
+    // An identifier outside the arms binds into its own block even while a frame has a free slot of its type,
+    // such as the second slot of an identifier used twice.
+    Id<int> twice;
+    Id<int> outside;
+    match(5)(
+        pattern(and_(0, twice, twice)) = [] {},
+        pattern(_) = [&outside] { matchPattern(7, outside); });
+    compare(*outside, 7);
+}
+
+void test34()
+{
+    auto const value = std::make_tuple(std::string(64, 'a'), std::string(64, 'b'), std::string(64, 'c'));
+    RefId<std::string> s;
+    compare(matchPattern(value, ds(_, _, s)), true);
+    compare(&*s, &std::get<2>(value));
+    RefId<std::string> u;
+    compare(matchPattern(value, ds(_, ooo(_), u, _)), true);
+    compare(&*u, &std::get<1>(value));
+    static_assert(std::tuple_size_v<decltype(drop<1>(value))> == 2);
+    static_assert(std::is_same_v<decltype(drop<1>(drop<1>(value))), decltype(drop<2>(value))>);
+}
+
+void test35()
+{
+    auto const shapeX = [](auto const &x) {
+        Id<int> i;
+        return match(x)(
+            pattern(ds(ooo(_), 1, ooo(_), 2, ooo(_), 3, ooo(_))) = [] { return 1; },
+            pattern(ds(i, ooo(_), 2, ooo(_), i)) = [] { return 2; },
+            pattern(_) = [] { return 3; });
+    };
+    std::array<int, 24> record{};
+    testMatch(record, 3, shapeX);
+    record[10] = 1;
+    record[15] = 2;
+    testMatch(record, 2, shapeX);
+    record[23] = 3;
+    testMatch(record, 1, shapeX);
+    record[5] = 3;
+    record[23] = 4;
+    testMatch(record, 3, shapeX);
+}
+
+void test36()
+{
+    auto const shapeX = [](auto const &x) {
+        Id<int> i;
+        return match(x)(
+            pattern(ds(1, 2, 3)) = [] { return 1; },
+            pattern(ds(ooo(_), 1, ooo(_), 2, ooo(_), 3, ooo(_))) = [] { return 2; },
+            pattern(ds(i, ooo(_ > 0), i)) = [&i] { return *i * 10; },
+            pattern(_) = [] { return 3; });
+    };
+    testMatch(std::vector<int>{1, 2, 3}, 1, shapeX);
+    testMatch(std::vector<int>{0, 1, 0, 2, 3}, 2, shapeX);
+    testMatch(std::vector<int>{4, 1, 1, 4}, 40, shapeX);
+    testMatch(std::vector<int>{4, 1, 0, 4}, 3, shapeX);
+    testMatch(std::vector<int>{}, 3, shapeX);
+
+    std::vector<int> record(10000);
+    record[1000] = 1;
+    record[5000] = 2;
+    testMatch(record, 3, shapeX);
+    record[9999] = 3;
+    testMatch(record, 2, shapeX);
+
+    auto const pathX = [](std::string_view path) {
+        return match(path)(
+            pattern(ds('/', ooo(_), '/', ooo(not_('/')))) = [] { return 2; },
+            pattern(ds('/', ooo(not_('/')))) = [] { return 1; },
+            pattern(_) = [] { return 0; });
+    };
+    testMatch("/usr", 1, pathX);
+    testMatch("/usr/local/bin", 2, pathX);
+    testMatch("usr", 0, pathX);
+    static_assert(!MatchFuncDefinedV<std::vector<int>, Ds<std::string> >);
+    static_assert(!MatchFuncDefinedV<std::vector<int>, Ds<Ooo<std::string> > >);
+}
+
+void test37()
+{
+    auto const windowX = [](auto const &x) {
+        return match(x)(
+            pattern(ds(7, ooo(3), 7)) = [] { return 3; },
+            pattern(ds(ooo(_ > 0))) = [] { return 1; },
+            pattern(ds(ooo(0), ooo(_ >= 0))) = [] { return 2; },
+            pattern(_) = [] { return 0; });
+    };
+    std::vector<int> window(1003, 5);
+    testMatch(window, 1, windowX);
+    window[997] = 0;
+    testMatch(window, 2, windowX);
+    window[998] = -1;
+    testMatch(window, 0, windowX);
+    std::vector<int> sevens(37, 3);
+    sevens.front() = 7;
+    sevens.back() = 7;
+    testMatch(sevens, 3, windowX);
+    sevens[20] = 4;
+    testMatch(sevens, 1, windowX);
+
+    auto const readingsX = [](std::vector<float> const &x) {
+        return match(x)(
+            pattern(ds(ooo(_ > 0.0f))) = [] { return 1; },
+            pattern(ds(ooo(_ <= 0), 2.5f)) = [] { return 2; },
+            pattern(_) = [] { return 0; });
+    };
+    std::vector<float> readings(19, 0.5f);
+    testMatch(readings, 1, readingsX);
+    readings[9] = std::numeric_limits<float>::quiet_NaN();
+    testMatch(readings, 0, readingsX);
+    std::fill(readings.begin(), readings.end(), -1.0f);
+    readings.back() = 2.5f;
+    testMatch(readings, 2, readingsX);
+}
+
+int gSegmentChecks = 0;
+
+int countedCheck(int value)
+{
+    ++gSegmentChecks;
+    return value;
+}
+
+void test38()
+{
+    auto const value = std::make_tuple(1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+    Id<int> j;
+    compare(matchPattern(value, ds(ooo(_), j, app(&countedCheck, 10))), true);
+    compare(*j, 9);
+    compare(gSegmentChecks, 1);
+    compare(matchPattern(value, ds(1, 2, ooo(_), ooo(_))), true);
+    compare(matchPattern(value, ds(ooo(_), ooo(_), 5, ooo(_), ooo(_))), true);
+    compare(matchPattern(value, ds(ooo(_), 11)), false);
+    compare(matchPattern(std::make_tuple(1), ds(ooo(_), 1, 1)), false);
+
+    gSegmentChecks = 0;
+    std::vector<int> const range(1000, 10);
+    compare(matchPattern(range, ds(ooo(_), ooo(_), app(&countedCheck, 10))), true);
+    compare(gSegmentChecks, 1);
+}
+
+void test39()
+{
+    static_assert(Ds<int, WildCard, Id<int> >::kMIN_SIZE == 3);
+    static_assert(Ds<int, WildCard, Id<int> >::kMAX_SIZE == 3);
+    static_assert(Ds<Ooo<WildCard>, int, Ooo<int> >::kMIN_SIZE == 1);
+    static_assert(Ds<Ooo<WildCard>, int, Ooo<int> >::kMAX_SIZE == std::numeric_limits<std::size_t>::max());
+
+    gSegmentChecks = 0;
+    compare(matchPattern(std::vector<int>{1, 2}, ds(app(&countedCheck, 1), 2, 3)), false);
+    compare(matchPattern(std::vector<int>{1, 2}, ds(app(&countedCheck, 1), 2, 3, ooo(_))), false);
+    compare(matchPattern(std::make_tuple(1, 2, 3), ds(app(&countedCheck, 1), 2)), false);
+    compare(gSegmentChecks, 0);
+    compare(matchPattern(std::vector<int>{1, 2, 3}, ds(app(&countedCheck, 1), 2, 3, ooo(_))), true);
+    compare(gSegmentChecks, 1);
+}
+
+void test40()
+{
+    static_assert(Ds<Ooo<int, 2, 3>, int>::kMIN_SIZE == 3);
+    static_assert(Ds<Ooo<int, 2, 3>, int>::kMAX_SIZE == 4);
+
+    compare(matchPattern(std::make_tuple(1, 2, 0), ds(ooo<2>(_ > 0), 0)), true);
+    compare(matchPattern(std::make_tuple(1, 0), ds(ooo<2>(_ > 0), 0)), false);
+    compare(matchPattern(std::make_tuple(1, 1, 1, 2), ds(ooo<1, 2>(1), ooo(_))), true);
+    compare(matchPattern(std::make_tuple(1, 1, 1, 2), ds(ooo<1, 2>(1), 2)), false);
+    compare(matchPattern(std::make_tuple(1, 5, 6, 7), ds(1, oon(_, 3u))), true);
+    compare(matchPattern(std::make_tuple(1, 5, 6), ds(1, oon(_, 3u))), false);
+    compare(matchPattern(std::make_tuple(4, 5, 6, 2), ds(oon(_ > 3, _ >= 2), ooo(_))), true);
+    compare(matchPattern(std::make_tuple(1, 2, 5, 3, 4), ds(ooo<2>(_), 5, ooo<2>(_))), true);
+    compare(matchPattern(std::make_tuple(1, 5, 3, 4), ds(ooo<2>(_), 5, ooo<2>(_))), false);
+
+    compare(matchPattern(std::vector<int>{1, 2, 0}, ds(ooo<2>(_ > 0), 0)), true);
+    compare(matchPattern(std::vector<int>{1, 0}, ds(ooo<2>(_ > 0), 0)), false);
+    compare(matchPattern(std::vector<int>{1, 1, 1, 2}, ds(ooo<1, 2>(1), ooo(_))), true);
+    compare(matchPattern(std::vector<int>{1, 1, 1, 2}, ds(ooo<1, 2>(1), 2)), false);
+    compare(matchPattern(std::vector<int>{1, 5, 6, 7}, ds(1, oon(_, 3u))), true);
+    compare(matchPattern(std::vector<int>{1, 5, 6}, ds(1, oon(_, 3u))), false);
+    compare(matchPattern(std::vector<int>{1, 2, 5, 3, 4}, ds(ooo<2>(_), 5, ooo<2>(_))), true);
+    compare(matchPattern(std::vector<int>{1, 5, 3, 4}, ds(ooo<2>(_), 5, ooo<2>(_))), false);
+
+    Id<std::size_t> n;
+    auto const length = [&n](auto const &values) {
+        return match(values)(
+            pattern(ds(oon(_ > 0, n), 0)) = [&n] { return *n; },
+            pattern(_) = [] { return std::size_t{0}; });
+    };
+    compare(length(std::make_tuple(4, 5, 6, 0)), std::size_t{3});
+    compare(length(std::vector<int>{4, 5, 0}), std::size_t{2});
+    compare(length(std::vector<int>{4, 0, 5}), std::size_t{0});
+}
+
+void test41()
+{
+    compare(matchPattern(std::make_tuple(1, 2, 3), ds(ooo(_ > 0), 3)), true);
+    compare(matchPattern(std::make_tuple(1, 2, 3), ds(ooo_possessive(_ > 0), 3)), false);
+    compare(matchPattern(std::make_tuple(1, 2, 0, 5), ds(ooo_possessive(_ > 0), 0, ooo(_))), true);
+    compare(matchPattern(std::make_tuple(1, 1, 2, 3), ds(ooo_possessive(1), ooo_possessive(2), 3)), true);
+    compare(matchPattern(std::make_tuple(1, 1, 2, 3), ds(ooo_possessive<3>(1), ooo(_))), false);
+    compare(matchPattern(std::vector<int>{1, 2, 3}, ds(ooo(_ > 0), 3)), true);
+    compare(matchPattern(std::vector<int>{1, 2, 3}, ds(ooo_possessive(_ > 0), 3)), false);
+    compare(matchPattern(std::vector<int>{1, 2, 0, 5}, ds(ooo_possessive(_ > 0), 0, ooo(_))), true);
+    compare(matchPattern(std::vector<int>{1, 1, 2, 3}, ds(ooo_possessive(1), ooo_possessive(2), 3)), true);
+    compare(matchPattern(std::vector<int>{1, 1, 2, 2}, ds(ooo_possessive(1), ooo_possessive(2), 3)), false);
+    compare(matchPattern(std::vector<int>{1, 1, 2, 3}, ds(ooo_possessive<3>(1), ooo(_))), false);
+
+    auto const split = [](auto const &values) {
+        Id<int> i;
+        return match(values)(
+            pattern(ds(ooo_greedy(_ > 0), i, ooo(_))) = [&i] { return *i; },
+            pattern(_) = [] { return -1; });
+    };
+    compare(split(std::make_tuple(1, 2, 0, 5)), 0);
+    compare(split(std::vector<int>{1, 2, 0, 5}), 0);
+    compare(split(std::vector<int>{1, 2}), 2);
+
+    gSegmentChecks = 0;
+    compare(matchPattern(std::vector<int>{1, 2, 3, 4, 5, 6}, ds(ooo_possessive(app(&countedCheck, _ > 0)), ooo(_), 0)), false);
+    compare(gSegmentChecks, 6);
+}
+
+void test42()
+{
+    auto const split = [](auto const &values) {
+        Id<int> i;
+        Id<int> j;
+        return match(values)(
+            pattern(ds(ooo_greedy(_), i, ooo(_), j, ooo(_))) = [&i, &j] { return *i * 10 + *j; },
+            pattern(_) = [] { return 0; });
+    };
+    compare(split(std::make_tuple(1, 2, 3)), 23);
+    compare(split(std::vector<int>{1, 2, 3}), 23);
+
+    // Shorter lengths of a greedy segment do not see the bindings made while measuring its run.
+    auto const bound = [](auto const &values) {
+        Id<int> x;
+        return match(values)(
+            pattern(ds(ooo_greedy(x), ooo(_), x)) = [&x] { return *x; },
+            pattern(_) = [] { return 0; });
+    };
+    compare(bound(std::make_tuple(1, 2)), 2);
+    compare(bound(std::vector<int>{1, 2}), 2);
+    compare(bound(std::make_tuple(3, 3, 1, 3)), 3);
+    compare(bound(std::vector<int>{3, 3, 1, 3}), 3);
+
+    // Each end tried for a segment binding nothing starts from the bindings made before it.
+    auto const repeated = [](auto const &values) {
+        Id<int> x;
+        return match(values)(
+            pattern(ds(ooo(_), x, ooo(_), x, ooo(_))) = [&x] { return *x; },
+            pattern(_) = [] { return -1; });
+    };
+    compare(repeated(std::make_tuple(2, 1, 1, 1, 0, 0)), 1);
+    compare(repeated(std::vector<int>{2, 1, 1, 1, 0, 0}), 1);
+    compare(repeated(std::vector<int>{2, 1, 3}), -1);
+
+    auto const alternatives = [](auto const &value) {
+        Id<int> i;
+        return match(value)(
+            pattern(or_(ds(i, 1), ds(_, i))) = [&i] { return *i; },
+            pattern(_) = [] { return 0; });
+    };
+    compare(alternatives(std::make_tuple(5, 2)), 2);
+    compare(alternatives(std::make_tuple(5, 1)), 5);
+
+    auto const negation = [](auto const &value) {
+        Id<int> i;
+        return match(value)(
+            pattern(ds(not_(ds(i, 1)), i)) = [&i] { return *i; },
+            pattern(_) = [] { return 0; });
+    };
+    compare(negation(std::make_tuple(std::make_tuple(5, 2), 7)), 7);
+    compare(negation(std::make_tuple(std::make_tuple(5, 1), 5)), 0);
+
+    // Bindings made by the handler are not undone when the match call ends.
+    Id<int> outside;
+    auto const local = [&outside](auto const &value) {
+        Id<int> i;
+        return match(value)(
+            pattern(i) = [&outside] {
+                Id<int> inner;
+                return matchPattern(7, inner) && matchPattern(*inner, outside) ? *inner : 0;
+            });
+    };
+    compare(local(1), 7);
+    compare(*outside, 7);
+}
+
+// A pattern defined outside the library, which does not tell which identifiers it holds.
+template <typename Pattern>
+class Wrapped
+{
+public:
+    Pattern pattern;
+};
+
+template <typename Pattern>
+class PatternTraits<Wrapped<Pattern> >
+{
+public:
+    template <typename Value>
+    static auto matchPatternImpl(Value const &value, Wrapped<Pattern> const &wrapped)
+    -> decltype(::matchPattern(value, wrapped.pattern))
+    {
+        return ::matchPattern(value, wrapped.pattern);
+    }
+    static void resetId(Wrapped<Pattern> const &wrapped)
+    {
+        ::resetId(wrapped.pattern);
+    }
+};
+
+void test43()
+{
+    static_assert(IsIdFree<std::tuple<Or<int, Relation<std::less<>, int> >, Ds<char, Ooo<WildCard> > > >::value);
+    static_assert(!IsIdFree<std::tuple<Ds<int, Ooo<Id<int> > > > >::value);
+    static_assert(!IsIdFree<std::tuple<Not<And<int, Id<int> > > > >::value);
+
+    Id<int> i;
+    compare(matchPattern(1, i), true);
+    compare(matchPattern(5, i), false);
+    resetId(ds(1, or_(2, not_(i)), ooo(_ > 0)));
+    compare(matchPattern(5, i), true);
+    resetId(ds(1, or_(2, _ < 3), ooo(_ > 0)));
+    compare(matchPattern(6, i), false);
+
+    static_assert(!IsIdFree<std::tuple<Wrapped<WildCard> > >::value);
+    Id<int> j;
+    auto const wrapped = match(std::make_tuple(5, 2))(
+        pattern(ds(Wrapped<Id<int> >{j}, _ < 2)) = [] { return 0; },
+        pattern(ds(_, j)) = [&j] { return *j; });
+    compare(wrapped, 2);
+}
+
+int gCopies = 0;
+int gMoves = 0;
+int gConversions = 0;
+
+// Counts how often it is copied or moved.
+class Tracked
+{
+public:
+    explicit Tracked(int value)
+        : mValue{value}
+    {
+        ++gConversions;
+    }
+    Tracked(Tracked const &other)
+        : mValue{other.mValue}
+    {
+        ++gCopies;
+    }
+    Tracked(Tracked &&other)
+        : mValue{other.mValue}
+    {
+        ++gMoves;
+    }
+    bool operator==(Tracked const &other) const
+    {
+        return mValue == other.mValue;
+    }
+    bool operator==(int other) const
+    {
+        return mValue == other;
+    }
+    int value() const
+    {
+        return mValue;
+    }
+
+private:
+    int mValue;
+};
+
+void test44()
+{
+    auto const first = [](auto const &values) {
+        Id<Tracked> t;
+        return match(values)(
+            pattern(ds(t, ooo(_))) = [&t] { return (*t).value(); },
+            pattern(_) = [] { return 0; });
+    };
+    auto const tuple = std::make_tuple(Tracked{1}, Tracked{2});
+    std::vector<Tracked> const vector{Tracked{3}, Tracked{4}};
+    gCopies = 0;
+    compare(first(tuple), 1);
+    compare(first(vector), 3);
+    compare(gCopies, 0);
+
+    auto const projected = [](int value) {
+        Id<Tracked> t;
+        return match(value)(
+            pattern(app([](int x) { return Tracked{x * 2}; }, t)) = [&t] { return (*t).value(); });
+    };
+    gCopies = 0;
+    gMoves = 0;
+    compare(projected(5), 10);
+    compare(gCopies, 0);
+    compare(gMoves, 1);
+
+    // A part of a temporary is copied, as the temporary is gone by the time the handler runs.
+    auto const part = [](int value) {
+        Id<Tracked> t;
+        return match(value)(
+            pattern(app([](int x) { return std::make_tuple(Tracked{x}, x); }, ds(t, _))) = [&t] { return (*t).value(); });
+    };
+    gCopies = 0;
+    compare(part(7), 7);
+    compare(gCopies, 1);
+    // Parts of a temporary can only be bound by identifiers able to copy them.
+    static_assert(CopiesBindings<std::tuple<Id<Tracked> > >::value);
+    static_assert(!CopiesBindings<std::tuple<Id<std::unique_ptr<int> > > >::value);
+    static_assert(!CopiesBindings<std::tuple<Id<int>, RefId<int> > >::value);
+
+    Id<std::unique_ptr<int> > p;
+    auto const owner = std::make_tuple(std::make_unique<int>(8), 1);
+    compare(match(owner)(pattern(ds(p, 1)) = [&p] { return **p; }), 8);
+    std::vector<std::unique_ptr<int> > owners;
+    owners.push_back(std::make_unique<int>(9));
+    compare(match(owners)(pattern(ds(p)) = [&p] { return **p; }, pattern(_) = [] { return 0; }), 9);
+
+    // Elements of a std::vector<bool> are temporary proxies, bindings keep copies of them.
+    auto const flag = [](std::vector<bool> const &flags) {
+        Id<bool> x;
+        return match(flags)(
+            pattern(ds(x, _)) = [&x] { return *x; },
+            pattern(_) = [] { return false; });
+    };
+    compare(flag({true, false}), true);
+    compare(flag({false, true}), false);
+
+    // The values of a match on several values are pointed to.
+    gCopies = 0;
+    Tracked const left{5};
+    Tracked const right{6};
+    Id<Tracked> l;
+    compare(match(left, right)(pattern(l, _) = [&l] { return (*l).value(); }), 5);
+    compare(gCopies, 0);
+}
+
+void test45()
+{
+    auto const second = [](auto const &values) {
+        Id<Tracked> t;
+        return match(values)(
+            pattern(ds(t, 0)) = [] { return 0; },
+            pattern(ds(t, 1)).when([&t] { return (*t).value() > 10; }) = [] { return 1; },
+            pattern(ds(t, 1)) = [&t] { return (*t).value(); });
+    };
+    gConversions = 0;
+    compare(second(std::make_tuple(5, 1)), 5);
+    // Converted once for the guard, once more for the last arm.
+    compare(gConversions, 2);
+
+    auto const projected = [](int value) {
+        Id<Tracked> t;
+        return match(value)(
+            pattern(app([](int x) { return std::make_tuple(Tracked{x}, x); }, ds(t, 0))) = [&t] { return (*t).value(); },
+            pattern(_) = [] { return -1; });
+    };
+    gCopies = 0;
+    compare(projected(3), -1);
+    compare(gCopies, 0);
+    compare(projected(0), 0);
+    compare(gCopies, 1);
+}
+
 int main()
 {
     test1();
@@ -641,5 +1525,29 @@ int main()
     test19();
     test20();
     test21();
+    test22();
+    test23();
+    test24();
+    test25();
+    test26();
+    test27();
+    test28();
+    test29();
+    test30();
+    test31();
+    test32();
+    test33();
+    test34();
+    test35();
+    test36();
+    test37();
+    test38();
+    test39();
+    test40();
+    test41();
+    test42();
+    test43();
+    test44();
+    test45();
     return 0;
 }
\ No newline at end of file
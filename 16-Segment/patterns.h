@@ -1,8 +1,28 @@
 #ifndef _PATTERNS_H_
 #define _PATTERNS_H_
 
+#include "core.h"
 #include <memory>
 #include <iostream>
+#include <functional>
+#include <limits>
+#include <variant>
+#include <array>
+#include <typeindex>
+#include <any>
+#include <unordered_map>
+#include <vector>
+#include <string_view>
+#include <initializer_list>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 template <typename Pattern>
 class PatternTraits;
@@ -14,10 +34,36 @@ auto matchPattern(Value const &value, Pattern const &pattern)
     return PatternTraits<Pattern>::matchPatternImpl(value, pattern);
 }
 
+// Types of the identifiers in a pattern, defined with the patterns.
+template <typename Pattern>
+class IdsOf;
+
+// Whether no pattern of the tuple contains an identifier, defined with IdsOf.
+template <typename PatternsTuple, typename = std::make_index_sequence<std::tuple_size<PatternsTuple>::value> >
+class IsIdFree;
+
+// Subpatterns without identifiers are skipped at compile time, so only the paths leading to identifiers are walked.
 template <typename Pattern>
 void resetId(Pattern const &pattern)
 {
-    PatternTraits<Pattern>::resetId(pattern);
+    if constexpr (!IsIdFree<std::tuple<Pattern> >::value)
+    {
+        PatternTraits<Pattern>::resetId(pattern);
+    }
+}
+
+// Runs an alternative, undoing the bindings it made when it fails. Nothing is recorded for patterns binding nothing.
+template <typename PatternsTuple, typename Alternative>
+bool tryAlternative(Alternative const &alternative)
+{
+    if constexpr (IsIdFree<PatternsTuple>::value)
+    {
+        return alternative();
+    }
+    else
+    {
+        return BindingTrail::attempt(alternative);
+    }
 }
 
 template <typename Pattern, typename Func>
@@ -26,24 +72,27 @@ class PatternPair
 public:
     using RetType = std::invoke_result_t<Func>;
 
-    PatternPair(Pattern const &pattern, Func const &func)
-        : mPattern{pattern}, mHandler{func}
+    PatternPair(Pattern pattern, Func const &func)
+        : mPattern{std::move(pattern)}, mHandler{func}
     {
     }
     template <typename Value>
     bool matchValue(Value const &value) const
     {
-        resetId(mPattern);
-        return ::matchPattern(value, mPattern);
+        return tryAlternative<std::tuple<Pattern> >([&value, this] { return ::matchPattern(value, mPattern); });
     }
     auto execute() const
     {
         return mHandler();
     }
+    auto const &pattern() const
+    {
+        return mPattern;
+    }
 
 private:
-    Pattern const &mPattern;
-    Func const &mHandler;
+    Pattern mPattern;
+    Func mHandler;
 };
 
 template <typename Pattern, typename Pred>
@@ -58,9 +107,14 @@ public:
     {
     }
     template <typename Func>
-    auto operator=(Func const &func)
+    auto operator=(Func const &func) const &
+    {
+        return PatternPair<Pattern, std::decay_t<Func> >{mPattern, func};
+    }
+    template <typename Func>
+    auto operator=(Func const &func) &&
     {
-        return PatternPair<Pattern, Func>{mPattern, func};
+        return PatternPair<Pattern, std::decay_t<Func> >{std::move(mPattern), func};
     }
     template <typename Pred>
     auto when(Pred const &pred)
@@ -69,7 +123,7 @@ public:
     }
 
 private:
-    Pattern const mPattern;
+    Pattern mPattern;
 };
 
 template <typename Pattern>
@@ -93,6 +147,9 @@ template <typename Pattern>
 class PatternTraits
 {
 public:
+    // Marks the plain values, compared for equality, which hold no identifiers.
+    using IsEquality = std::true_type;
+
     template <typename Value>
     static auto matchPatternImpl(Value const &value, Pattern const &pattern)
     -> decltype(pattern == value)
@@ -109,6 +166,12 @@ class WildCard
 };
 constexpr WildCard _;
 
+template <typename Pattern, typename = std::void_t<> >
+inline constexpr bool isEqualityPatternV = false;
+
+template <typename Pattern>
+inline constexpr bool isEqualityPatternV<Pattern, std::void_t<typename PatternTraits<Pattern>::IsEquality> > = true;
+
 template <>
 class PatternTraits<WildCard>
 {
@@ -158,7 +221,7 @@ public:
     {
         return std::apply(
             [&value](Patterns const &...patterns) {
-                return (::matchPattern(value, patterns) || ...);
+                return (tryAlternative<std::tuple<Patterns> >([&value, &patterns] { return ::matchPattern(value, patterns); }) || ...);
             },
             orPat.patterns());
     }
@@ -238,6 +301,87 @@ auto app(Unary const &unary, Pattern const &pattern)
     return App<Unary, Pattern>{unary, pattern};
 }
 
+// Caches `std::invoke(unary, value)` on the scrutinee of the running match call, so that
+// arms sharing the same projection (e.g. a virtual `kind()`) evaluate it only once per call.
+// Only unaries without state of their own are cached, and only results that are lvalue references
+// or trivially copyable, so a cached result never dangles.
+template <typename Unary, typename Value>
+class AppMemo
+{
+    using Result = std::invoke_result_t<Unary const &, Value const &>;
+    using Cached = std::conditional_t<std::is_reference_v<Result>, std::remove_reference_t<Result> *, Result>;
+
+    class Slot
+    {
+    public:
+        std::uint64_t epoch = 0;
+        void const *value = nullptr;
+        std::optional<Unary> unary;
+        std::optional<Cached> cached;
+    };
+
+public:
+    static constexpr bool enabled =
+        (std::is_empty_v<Unary> || std::is_pointer_v<Unary> || std::is_member_pointer_v<Unary>) &&
+        (std::is_lvalue_reference_v<Result> || (!std::is_reference_v<Result> && std::is_trivially_copyable_v<Result>));
+
+    static Result invoke(Unary const &unary, Value const &value)
+    {
+        auto const *const scope = MatchScope::current();
+        if (scope == nullptr || !scope->contains(std::addressof(value)))
+        {
+            return std::invoke(unary, value);
+        }
+        thread_local Slot slot;
+        if (slot.epoch != scope->epoch() || slot.value != std::addressof(value) || !sameUnary(*slot.unary, unary))
+        {
+            slot.unary.emplace(unary);
+            if constexpr (std::is_reference_v<Result>)
+            {
+                slot.cached.emplace(std::addressof(std::invoke(unary, value)));
+            }
+            else
+            {
+                slot.cached.emplace(std::invoke(unary, value));
+            }
+            slot.epoch = scope->epoch();
+            slot.value = std::addressof(value);
+        }
+        if constexpr (std::is_reference_v<Result>)
+        {
+            return **slot.cached;
+        }
+        else
+        {
+            return *slot.cached;
+        }
+    }
+
+private:
+    static bool sameUnary(Unary const &lhs, Unary const &rhs)
+    {
+        if constexpr (std::is_empty_v<Unary>)
+        {
+            return true;
+        }
+        else
+        {
+            return lhs == rhs;
+        }
+    }
+};
+
+// Patterns able to take over a temporary when binding it: identifiers owning their value.
+template <typename Pattern, typename Value, typename = std::void_t<> >
+inline constexpr bool canMatchTemporaryV = false;
+
+template <typename Pattern, typename Value>
+inline constexpr bool canMatchTemporaryV<Pattern, Value, std::void_t<decltype(std::declval<Pattern const &>().matchTemporary(std::declval<Value>()))> > = true;
+
+// Whether all the identifiers can keep a copy of what they bind, see IdBinding::materialize.
+template <typename Ids>
+class CopiesBindings;
+
 template <typename Unary, typename Pattern>
 class PatternTraits<App<Unary, Pattern> >
 {
@@ -246,38 +390,168 @@ public:
     static auto matchPatternImpl(Value const &value, App<Unary, Pattern> const &appPat)
     -> decltype(::matchPattern(std::invoke(appPat.unary(), value), appPat.pattern()))
     {
-        return ::matchPattern(std::invoke(appPat.unary(), value), appPat.pattern());
+        using Result = std::invoke_result_t<Unary const &, Value const &>;
+        if constexpr (std::is_reference_v<Result>)
+        {
+            return ::matchPattern(project(value, appPat), appPat.pattern());
+        }
+        else if constexpr (canMatchTemporaryV<Pattern, Result>)
+        {
+            // Nothing else sees the result, so an identifier binding it moves it.
+            return appPat.pattern().matchTemporary(project(value, appPat));
+        }
+        else if constexpr (IsIdFree<std::tuple<Pattern> >::value)
+        {
+            return ::matchPattern(project(value, appPat), appPat.pattern());
+        }
+        else
+        {
+            // Identifiers bound to parts of the result refer to them while the subpattern is tried, and copy them
+            // only once it matched, before the result goes away.
+            static_assert(CopiesBindings<typename IdsOf<Pattern>::type>::value,
+                          "Identifiers bound to parts of an app result must own copies of them: use an Id of a copyable type, not a RefId.");
+            auto const &result = project(value, appPat);
+            MatchScope::Part const part{std::addressof(result), std::addressof(result) + 1};
+            BindingTrail::Checkpoint const checkpoint;
+            if (::matchPattern(result, appPat.pattern()))
+            {
+                checkpoint.materialize();
+                return true;
+            }
+            checkpoint.rollback();
+            return false;
+        }
     }
     static void resetId(App<Unary, Pattern> const &appPat)
     {
         return ::resetId(appPat.pattern());
     }
+
+private:
+    template <typename Value>
+    static decltype(auto) project(Value const &value, App<Unary, Pattern> const &appPat)
+    {
+        if constexpr (AppMemo<Unary, Value>::enabled)
+        {
+            return AppMemo<Unary, Value>::invoke(appPat.unary(), value);
+        }
+        else
+        {
+            return std::invoke(appPat.unary(), value);
+        }
+    }
+};
+
+// Relational patterns keep their bounds visible so that arms can be dispatched as intervals.
+template <typename Op, typename T>
+class Relation
+{
+public:
+    explicit Relation(T const &bound)
+        : mBound{bound}
+    {
+    }
+    auto const &bound() const
+    {
+        return mBound;
+    }
+
+private:
+    T const mBound;
+};
+
+template <typename T>
+using Lt = Relation<std::less<>, T>;
+template <typename T>
+using Le = Relation<std::less_equal<>, T>;
+template <typename T>
+using Gt = Relation<std::greater<>, T>;
+template <typename T>
+using Ge = Relation<std::greater_equal<>, T>;
+
+template <typename Op, typename T>
+class PatternTraits<Relation<Op, T> >
+{
+public:
+    template <typename Value>
+    static auto matchPatternImpl(Value const &value, Relation<Op, T> const &relation)
+    -> decltype(Op{}(value, relation.bound()))
+    {
+        return Op{}(value, relation.bound());
+    }
+    static void resetId(Relation<Op, T> const &)
+    {
+    }
 };
 
 template <typename T>
 auto operator<(WildCard const &, T const &t)
 {
-    return meet([t](auto &&p) { return p < t; });
+    return Lt<T>{t};
 }
 
 template <typename T>
 auto operator<=(WildCard const &, T const &t)
 {
-    return meet([t](auto &&p) { return p <= t; });
+    return Le<T>{t};
 }
 
 template <typename T>
 auto operator>=(WildCard const &, T const &t)
 {
-    return meet([t](auto &&p) { return p >= t; });
+    return Ge<T>{t};
 }
 
 template <typename T>
 auto operator>(WildCard const &, T const &t)
 {
-    return meet([t](auto &&p) { return p > t; });
+    return Gt<T>{t};
+}
+
+// Closed range [low, high].
+template <typename T>
+class Between
+{
+public:
+    Between(T const &low, T const &high)
+        : mLow{low}, mHigh{high}
+    {
+    }
+    auto const &low() const
+    {
+        return mLow;
+    }
+    auto const &high() const
+    {
+        return mHigh;
+    }
+
+private:
+    T const mLow;
+    T const mHigh;
+};
+
+template <typename T>
+auto between(T const &low, T const &high)
+{
+    return Between<T>{low, high};
 }
 
+template <typename T>
+class PatternTraits<Between<T> >
+{
+public:
+    template <typename Value>
+    static auto matchPatternImpl(Value const &value, Between<T> const &range)
+    -> decltype(range.low() <= value && value <= range.high())
+    {
+        return range.low() <= value && value <= range.high();
+    }
+    static void resetId(Between<T> const &)
+    {
+    }
+};
+
 template <typename... Patterns>
 class And
 {
@@ -356,7 +630,18 @@ public:
     static auto matchPatternImpl(Value const &value, Not<Pattern> const &notPat)
     -> decltype(!::matchPattern(value, notPat.pattern()))
     {
-        return !::matchPattern(value, notPat.pattern());
+        if constexpr (IsIdFree<std::tuple<Pattern> >::value)
+        {
+            return !::matchPattern(value, notPat.pattern());
+        }
+        else
+        {
+            // Whether the pattern matches or not, what it bound is never seen.
+            BindingTrail::Checkpoint const checkpoint;
+            bool const matched = ::matchPattern(value, notPat.pattern());
+            checkpoint.rollback();
+            return !matched;
+        }
     }
     static void resetId(Not<Pattern> const &notPat)
     {
@@ -364,463 +649,2736 @@ public:
     }
 };
 
-template <typename... Ts>
-class Debug;
-
-template <bool own>
-class IdTrait;
-
-template <>
-class IdTrait<true>
+// Matches the alternative T of a std::variant, or a std::any holding a T, against the given pattern.
+template <typename T, typename Pattern>
+class Alt
 {
 public:
-    template <typename Type, typename Value>
-    static auto matchValueImpl(std::unique_ptr<Type> &ptr, Value const &value)
-    -> decltype(ptr = std::make_unique<Type>(value), void())
+    explicit Alt(Pattern const &pattern)
+        : mPattern{pattern}
     {
-        ptr = std::make_unique<Type>(value);
     }
-};
-
-template <>
-class IdTrait<false>
-{
-public:
-    template <typename Ptr, typename Value>
-    static auto matchValueImpl(Ptr &ptr, Value const &value)
-    -> decltype(ptr.reset(&value), void())
+    auto const &pattern() const
     {
-        ptr.reset(&value);
+        return mPattern;
     }
+
+private:
+    Pattern const mPattern;
 };
 
-template <typename Type, bool own = true>
-class Id
+template <typename T, typename Pattern>
+auto alt(Pattern const &pattern)
 {
-    class NoDelete
-    {
-    public:
-        void operator()(Type const *) {}
-    };
-    using PtrT = std::conditional_t<own, std::unique_ptr<Type const>, std::unique_ptr<Type const, NoDelete> >;
-    mutable std::shared_ptr<PtrT> mValue = std::make_shared<PtrT>();
+    return Alt<T, Pattern>{pattern};
+}
 
+template <typename T, typename Pattern>
+class PatternTraits<Alt<T, Pattern> >
+{
 public:
-    template <typename Value>
-    auto matchValue(Value const &value) const
-    -> decltype(**mValue == value, IdTrait<own>::matchValueImpl(*mValue, value), bool{})
+    template <typename... Ts>
+    static auto matchPatternImpl(std::variant<Ts...> const &value, Alt<T, Pattern> const &altPat)
+    -> decltype(std::get_if<T>(&value) && ::matchPattern(std::declval<T const &>(), altPat.pattern()))
     {
-        if (*mValue)
-        {
-            return **mValue == value;
-        }
-        IdTrait<own>::matchValueImpl(*mValue, value);
-        return true;
+        auto const *const alternative = std::get_if<T>(&value);
+        return alternative != nullptr && ::matchPattern(*alternative, altPat.pattern());
     }
-    void reset() const
+    static auto matchPatternImpl(std::any const &value, Alt<T, Pattern> const &altPat)
+    -> decltype(::matchPattern(std::declval<T const &>(), altPat.pattern()))
     {
-        (*mValue).reset();
+        auto const *const alternative = std::any_cast<T>(&value);
+        return alternative != nullptr && ::matchPattern(*alternative, altPat.pattern());
     }
-    Type const &value() const
+    static void resetId(Alt<T, Pattern> const &altPat)
     {
-        return **mValue;
+        ::resetId(altPat.pattern());
     }
-    Type const &operator*() const
+};
+
+// Matches a polymorphic object whose dynamic type is T or derives from T.
+template <typename T, typename Pattern>
+class Dyn
+{
+public:
+    explicit Dyn(Pattern const &pattern)
+        : mPattern{pattern}
     {
-        return value();
+    }
+    auto const &pattern() const
+    {
+        return mPattern;
     }
 
 private:
-    template <typename P, typename Value>
-    auto matchValueImpl(P const &p, Value const &value) const;
+    Pattern const mPattern;
 };
 
-template <typename Type>
-using RefId = Id<Type, false>;
+template <typename T, typename Pattern>
+auto dyn(Pattern const &pattern)
+{
+    return Dyn<T, Pattern>{pattern};
+}
 
-template <typename Type, bool own>
-class PatternTraits<Id<Type, own> >
+template <typename T, typename Pattern>
+class PatternTraits<Dyn<T, Pattern> >
 {
 public:
     template <typename Value>
-    static auto matchPatternImpl(Value const &value, Id<Type, own> const &idPat)
-    -> decltype(idPat.matchValue(value))
+    static auto matchPatternImpl(Value const &value, Dyn<T, Pattern> const &dynPat)
+    -> decltype(dynamic_cast<T const *>(&value), ::matchPattern(std::declval<T const &>(), dynPat.pattern()))
     {
-        return idPat.matchValue(value);
+        auto const *const object = dynamic_cast<T const *>(&value);
+        return object != nullptr && ::matchPattern(*object, dynPat.pattern());
     }
-    static void resetId(Id<Type, own> const &idPat)
+    static void resetId(Dyn<T, Pattern> const &dynPat)
     {
-        idPat.reset();
+        ::resetId(dynPat.pattern());
     }
 };
 
-template <typename... Patterns>
-class Ds
+template <typename... Ts>
+class Debug;
+
+template <bool own>
+class IdTrait;
+
+// The binding of an owning Id: a pointer to a value known to outlive the handler, or else a value of its own.
+// A value of another type is only referred to while the arm is tried, and converted when first read.
+template <typename Type>
+class IdBinding
 {
 public:
-    explicit Ds(Patterns const &...patterns)
-        : mPatterns{patterns...}
+    IdBinding() = default;
+    IdBinding(IdBinding &&other)
     {
+        *this = std::move(other);
     }
-    auto const &patterns() const
+    IdBinding &operator=(IdBinding &&other)
     {
-        return mPatterns;
+        if (other.mOwned)
+        {
+            emplace(std::move(*other.mOwned));
+        }
+        else
+        {
+            mOwned.reset();
+            mValue = other.mValue;
+        }
+        mSource = other.mSource;
+        mConvert = other.mConvert;
+        return *this;
+    }
+
+    explicit operator bool() const
+    {
+        return mValue != nullptr || mSource != nullptr;
+    }
+    Type const &operator*() const
+    {
+        if (mValue == nullptr)
+        {
+            mValue = &mOwned.emplace(mConvert(mSource));
+            mSource = nullptr;
+        }
+        return *mValue;
+    }
+    void refer(Type const &value)
+    {
+        mValue = &value;
+    }
+    template <typename Value>
+    void defer(Value const &source)
+    {
+        mSource = &source;
+        mConvert = [](void const *from) { return Type(*static_cast<Value const *>(from)); };
+    }
+    template <typename... Args>
+    void emplace(Args &&...args)
+    {
+        mValue = &mOwned.emplace(std::forward<Args>(args)...);
+    }
+    // Copies or converts the value referred to, if any.
+    void materialize()
+    {
+        if (mSource != nullptr)
+        {
+            static_cast<void>(**this);
+        }
+        else if constexpr (std::is_copy_constructible_v<Type>)
+        {
+            if (mValue != nullptr && !mOwned)
+            {
+                emplace(*mValue);
+            }
+        }
     }
 
 private:
-    std::tuple<Patterns...> mPatterns;
+    mutable std::optional<Type> mOwned;
+    mutable Type const *mValue = nullptr;
+    mutable void const *mSource = nullptr;
+    Type (*mConvert)(void const *) = nullptr;
 };
 
-template <typename... Patterns>
-auto ds(Patterns const &...patterns) -> Ds<Patterns...>
-{
-    return Ds<Patterns...>{patterns...};
-}
-
-namespace impl
+template <>
+class IdTrait<true>
 {
-    // std::apply implementation from cppreference, except that std::get -> get to allow for ADL
-    namespace detail
+public:
+    // Values are kept inline, in the frame slot or the Id's shared block, so binding does not allocate on its own.
+    template <typename Type>
+    using StorageT = IdBinding<Type>;
+    // Values inside the scrutinee of the running match call outlive its handler, so they are referred to and only
+    // copied or converted when needed, see IdBinding. So are parts of app results, which the app pattern copies
+    // before they go away. Any other value, such as a temporary, is copied at once.
+    template <typename Type, typename Value>
+    static auto matchValueImpl(StorageT<Type> &storage, Value const &value, MatchScope const *scope)
+    -> std::enable_if_t<std::is_same_v<Value, Type> || std::is_constructible_v<Type, Value const &>, bool>
     {
-        template <class F, class Tuple, std::size_t... I>
-        constexpr decltype(auto) apply_impl(F &&f, Tuple &&t, std::index_sequence<I...>)
+        bool const referable = scope != nullptr && scope->mayReferTo(std::addressof(value));
+        if constexpr (std::is_same_v<Value, Type>)
         {
-            // This implementation is valid since C++20 (via P1065R2)
-            // In C++17, a constexpr counterpart of std::invoke is actually needed here
-            using std::get;
-            return std::invoke(std::forward<F>(f), get<I>(std::forward<Tuple>(t))...);
+            if (referable)
+            {
+                storage.refer(value);
+                return true;
+            }
+            if constexpr (!std::is_copy_constructible_v<Type>)
+            {
+                // Outside of a match call the caller keeps the value, as for RefId. Within one, a value that
+                // cannot be copied is only bound from the scrutinee.
+                if (scope == nullptr)
+                {
+                    storage.refer(value);
+                }
+                return scope == nullptr;
+            }
+        }
+        else
+        {
+            if (referable)
+            {
+                storage.defer(value);
+                return true;
+            }
+        }
+        if constexpr (std::is_constructible_v<Type, Value const &>)
+        {
+            storage.emplace(value);
+        }
+        return true;
+    }
+};
+
+template <>
+class IdTrait<false>
+{
+public:
+    template <typename Type>
+    using StorageT = Type const *;
+    template <typename Type, typename Value>
+    static auto matchValueImpl(StorageT<Type> &storage, Value const &value, MatchScope const *)
+    -> decltype(storage = &value, bool{})
+    {
+        storage = &value;
+        return true;
+    }
+};
+
+// Tags the type of the storage of a frame slot.
+template <typename Storage>
+inline constexpr char kStorageTag = 0;
+
+template <typename Type, bool own = true>
+class Id
+{
+public:
+    using StorageT = typename IdTrait<own>::template StorageT<Type>;
+    // Whether a binding can keep a copy of the value it refers to.
+    static constexpr bool kCOPIES = own && std::is_copy_constructible_v<Type>;
+
+private:
+    // Shared by the copies of the Id, holds the binding when no match call has a slot for it.
+    mutable std::shared_ptr<StorageT> mValue = std::make_shared<StorageT>();
+
+    StorageT &storage() const
+    {
+        if (auto *const frame = MatchFrame::current())
+        {
+            if (auto *const slot = frame->claim(mValue.get(), &kStorageTag<StorageT>))
+            {
+                return *static_cast<StorageT *>(slot);
+            }
+        }
+        return *mValue;
+    }
+    StorageT const &bound() const
+    {
+        if (auto const *const frame = MatchFrame::current())
+        {
+            if (auto const *const slot = frame->find(mValue.get()))
+            {
+                return *static_cast<StorageT const *>(slot);
+            }
+        }
+        return *mValue;
+    }
+
+public:
+    template <typename Value>
+    auto matchValue(Value const &value) const
+    -> decltype(**mValue == value, IdTrait<own>::matchValueImpl(*mValue, value, MatchScope::current()), bool{})
+    {
+        auto &binding = storage();
+        if (binding)
+        {
+            return *binding == value;
+        }
+        if (!IdTrait<own>::matchValueImpl(binding, value, MatchScope::current()))
+        {
+            return false;
+        }
+        BindingTrail::record(binding);
+        return true;
+    }
+    // Binds a temporary of the bound type by moving it, or compares against it.
+    template <typename Value, typename = std::enable_if_t<own && std::is_same_v<Value, Type> > >
+    auto matchTemporary(Value &&value) const
+    -> decltype(**mValue == value, bool{})
+    {
+        auto &binding = storage();
+        if (binding)
+        {
+            return *binding == value;
+        }
+        binding.emplace(std::move(value));
+        BindingTrail::record(binding);
+        return true;
+    }
+    void reset() const
+    {
+        storage() = StorageT{};
+    }
+    Type const &value() const
+    {
+        return *bound();
+    }
+    Type const &operator*() const
+    {
+        return value();
+    }
+
+private:
+    template <typename P, typename Value>
+    auto matchValueImpl(P const &p, Value const &value) const;
+};
+
+template <typename Type>
+using RefId = Id<Type, false>;
+
+template <typename Type, bool own>
+class PatternTraits<Id<Type, own> >
+{
+public:
+    template <typename Value>
+    static auto matchPatternImpl(Value const &value, Id<Type, own> const &idPat)
+    -> decltype(idPat.matchValue(value))
+    {
+        return idPat.matchValue(value);
+    }
+    static void resetId(Id<Type, own> const &idPat)
+    {
+        idPat.reset();
+    }
+};
+
+inline constexpr std::size_t kUNBOUNDED = std::numeric_limits<std::size_t>::max();
+
+// How a segment chooses its length: the shortest first, the longest first, or the longest run only, never given back.
+enum class SegmentMode
+{
+    kLAZY,
+    kGREEDY,
+    kPOSSESSIVE
+};
+
+// A segment of values all matching a pattern, whose length is between the bounds and matches the length pattern.
+template <typename Pattern, std::size_t minSize = 0, std::size_t maxSize = kUNBOUNDED, typename Length = WildCard,
+          SegmentMode mode = SegmentMode::kLAZY>
+class Ooo;
+
+template <typename Pattern>
+class IsOoo : public std::false_type
+{
+};
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class IsOoo<Ooo<Pattern, minSize, maxSize, Length, mode> > : public std::true_type
+{
+};
+
+template <typename Pattern>
+inline constexpr bool isOooV = IsOoo<std::decay_t<Pattern> >::value;
+
+// Bounds on the number of values a subpattern of a ds takes.
+template <typename Pattern>
+class SegmentSize
+{
+public:
+    static constexpr std::size_t kMIN = 1;
+    static constexpr std::size_t kMAX = 1;
+    static constexpr SegmentMode kMODE = SegmentMode::kLAZY;
+};
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class SegmentSize<Ooo<Pattern, minSize, maxSize, Length, mode> >
+{
+public:
+    static constexpr std::size_t kMIN = minSize;
+    static constexpr std::size_t kMAX = maxSize;
+    static constexpr SegmentMode kMODE = mode;
+};
+
+constexpr std::size_t saturatingSum(std::initializer_list<std::size_t> sizes)
+{
+    std::size_t sum = 0;
+    for (auto const size : sizes)
+    {
+        sum = size > kUNBOUNDED - sum ? kUNBOUNDED : sum + size;
+    }
+    return sum;
+}
+
+template <typename... Patterns>
+class Ds
+{
+public:
+    // Bounds on the number of values that can match: each subpattern takes one value, except ooo which take any number within their bounds.
+    static constexpr std::size_t kMIN_SIZE = saturatingSum({SegmentSize<Patterns>::kMIN...});
+    static constexpr std::size_t kMAX_SIZE = saturatingSum({SegmentSize<Patterns>::kMAX...});
+
+    explicit Ds(Patterns const &...patterns)
+        : mPatterns{patterns...}
+    {
+    }
+    auto const &patterns() const
+    {
+        return mPatterns;
+    }
+
+private:
+    std::tuple<Patterns...> mPatterns;
+};
+
+template <typename... Patterns>
+auto ds(Patterns const &...patterns) -> Ds<Patterns...>
+{
+    return Ds<Patterns...>{patterns...};
+}
+
+namespace impl
+{
+    // std::apply implementation from cppreference, except that std::get -> get to allow for ADL
+    namespace detail
+    {
+        template <class F, class Tuple, std::size_t... I>
+        constexpr decltype(auto) apply_impl(F &&f, Tuple &&t, std::index_sequence<I...>)
+        {
+            // This implementation is valid since C++20 (via P1065R2)
+            // In C++17, a constexpr counterpart of std::invoke is actually needed here
+            using std::get;
+            return std::invoke(std::forward<F>(f), get<I>(std::forward<Tuple>(t))...);
+        }
+    } // namespace detail
+
+    template <class F, class Tuple>
+    constexpr auto apply(F &&f, Tuple &&t)
+    -> decltype(
+    detail::apply_impl(
+        std::forward<F>(f), std::forward<Tuple>(t),
+        std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple> > >{}))
+    {
+        return detail::apply_impl(
+            std::forward<F>(f), std::forward<Tuple>(t),
+            std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple> > >{});
+    }
+}
+
+template <typename Value, typename Pattern, typename = std::void_t<> >
+struct MatchFuncDefined : std::false_type
+{
+};
+
+template <typename Value, typename Pattern>
+struct MatchFuncDefined<Value, Pattern, std::void_t<decltype(::matchPattern(std::declval<Value>(), std::declval<Pattern>()))> >
+    : std::true_type
+{
+};
+
+template <typename Value, typename Pattern>
+inline constexpr bool MatchFuncDefinedV = MatchFuncDefined<Value, Pattern>::value;
+
+using std::get;
+
+// The elements [offset, offset + size) of a tuple, referred to in place and never copied.
+template <typename Tuple, std::size_t offset, std::size_t size>
+class TupleView
+{
+public:
+    explicit TupleView(Tuple const &tuple)
+        : mTuple{tuple}
+    {
+    }
+    Tuple const &base() const
+    {
+        return mTuple;
+    }
+
+private:
+    Tuple const &mTuple;
+};
+
+template <std::size_t I, typename Tuple, std::size_t offset, std::size_t size>
+decltype(auto) get(TupleView<Tuple, offset, size> const &view)
+{
+    static_assert(I < size);
+    return get<I + offset>(view.base());
+}
+
+template <typename Tuple, std::size_t offset, std::size_t size>
+class std::tuple_size<TupleView<Tuple, offset, size> > : public std::integral_constant<std::size_t, size>
+{
+};
+
+template <std::size_t I, typename Tuple, std::size_t offset, std::size_t size>
+class std::tuple_element<I, TupleView<Tuple, offset, size> > : public std::tuple_element<I + offset, Tuple>
+{
+};
+
+template <typename Tuple, std::size_t offset, std::size_t size, typename Other, std::size_t... I>
+bool tupleViewEqual(TupleView<Tuple, offset, size> const &view, Other const &other, std::index_sequence<I...>)
+{
+    return ((get<I>(view) == get<I>(other)) && ...);
+}
+
+template <typename Tuple, std::size_t offset, std::size_t size, typename Other>
+auto operator==(TupleView<Tuple, offset, size> const &view, Other const &other)
+-> decltype(std::tuple_size<Other>::value, bool{})
+{
+    if constexpr (std::tuple_size<Other>::value != size)
+    {
+        return false;
+    }
+    else
+    {
+        return tupleViewEqual(view, other, std::make_index_sequence<size>{});
+    }
+}
+
+template <std::size_t N, typename Tuple>
+auto drop(Tuple const &t)
+-> TupleView<Tuple, N, std::tuple_size<Tuple>::value - N>
+{
+    return TupleView<Tuple, N, std::tuple_size<Tuple>::value - N>{t};
+}
+
+template <std::size_t N, typename Tuple, std::size_t offset, std::size_t size>
+auto drop(TupleView<Tuple, offset, size> const &view)
+-> TupleView<Tuple, offset + N, size - N>
+{
+    return TupleView<Tuple, offset + N, size - N>{view.base()};
+}
+
+template <typename ValuesTuple, typename PatternsTuple>
+bool tryOooMatch(ValuesTuple const &values, PatternsTuple const &patterns);
+
+template <typename Value, typename = std::void_t<> >
+struct IsTupleLike : std::false_type
+{
+};
+
+template <typename Value>
+struct IsTupleLike<Value, std::void_t<decltype(std::tuple_size<Value>::value)> > : std::true_type
+{
+};
+
+template <typename Value>
+inline constexpr bool isTupleLikeV = IsTupleLike<std::decay_t<Value> >::value;
+
+// Sequences whose size is only known at run time, destructured by ds element by element.
+// Specialize it for other contiguous containers to match them with ds.
+template <typename Value>
+class IsRuntimeRange : public std::false_type
+{
+};
+
+template <typename T, typename Allocator>
+class IsRuntimeRange<std::vector<T, Allocator> > : public std::true_type
+{
+};
+
+template <typename CharT, typename Traits>
+class IsRuntimeRange<std::basic_string_view<CharT, Traits> > : public std::true_type
+{
+};
+
+#if __cplusplus >= 202002L
+template <typename T, std::size_t extent>
+class IsRuntimeRange<std::span<T, extent> > : public std::true_type
+{
+};
+#endif
+
+template <typename Value>
+inline constexpr bool isRuntimeRangeV = IsRuntimeRange<std::decay_t<Value> >::value;
+
+template <typename Range, typename = std::void_t<> >
+inline constexpr bool isContiguousRangeV = false;
+
+template <typename Range>
+inline constexpr bool isContiguousRangeV<Range, std::void_t<decltype(std::data(std::declval<Range const &>()))> > = true;
+
+// The elements of a contiguous range inside the scrutinee last as long as the scrutinee.
+template <typename Range>
+auto elementsPart(Range const &values)
+{
+    if constexpr (isContiguousRangeV<Range>)
+    {
+        return MatchScope::Part{&values, std::data(values), std::data(values) + std::size(values)};
+    }
+    else
+    {
+        return std::tuple<>{};
+    }
+}
+
+// The pattern an element of a range is matched against, the subpattern for an ooo.
+template <typename Pattern>
+class SegmentPattern
+{
+public:
+    using type = Pattern;
+};
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class SegmentPattern<Ooo<Pattern, minSize, maxSize, Length, mode> >
+{
+public:
+    using type = Pattern;
+};
+
+// An ooo without bounds nor length pattern.
+template <typename Pattern>
+inline constexpr bool isPlainOooV = false;
+
+template <typename Pattern>
+inline constexpr bool isPlainOooV<Ooo<Pattern> > = true;
+
+template <typename Range, typename... Patterns>
+bool rangeMatch(Range const &values, std::tuple<Patterns...> const &patterns);
+
+// Whether the first of the patterns is an ooo, false when there are none.
+template <typename PatternsTuple, typename Enable = void>
+inline constexpr bool isOooHeadV = false;
+
+template <typename PatternsTuple>
+inline constexpr bool isOooHeadV<PatternsTuple, std::enable_if_t<(std::tuple_size<PatternsTuple>::value > 0)> > =
+    isOooV<std::tuple_element_t<0, PatternsTuple> >;
+
+// Matches the values of a tuple, or of a view of one, against the patterns of a Ds, one by one.
+template <typename ValuesTuple, typename PatternsTuple, typename Enable = void>
+class TupleMatchHelper
+{
+    template <typename VT = ValuesTuple>
+    static bool tupleMatchImpl(VT const &values, PatternsTuple const &patterns) = delete;
+};
+
+template <typename ValuesTuple, typename PatternsTuple>
+class TupleMatchHelper<ValuesTuple, PatternsTuple,
+                       std::enable_if_t<(std::tuple_size<ValuesTuple>::value > 0) && (std::tuple_size<PatternsTuple>::value > 0) &&
+                                        !isOooHeadV<PatternsTuple> > >
+{
+public:
+    template <typename VT = ValuesTuple>
+    static auto tupleMatchImpl(VT const &values, PatternsTuple const &patterns)
+    -> decltype(::matchPattern(get<0>(values), get<0>(patterns)) && TupleMatchHelper<decltype(drop<1>(values)), decltype(drop<1>(patterns))>::tupleMatchImpl(drop<1>(values), drop<1>(patterns)))
+    {
+        return ::matchPattern(get<0>(values), get<0>(patterns)) && TupleMatchHelper<decltype(drop<1>(values)), decltype(drop<1>(patterns))>::tupleMatchImpl(drop<1>(values), drop<1>(patterns));
+    }
+};
+
+template <typename ValuesTuple, typename PatternsTuple>
+class TupleMatchHelper<ValuesTuple, PatternsTuple,
+                       std::enable_if_t<(std::tuple_size<ValuesTuple>::value > 0) && std::tuple_size<PatternsTuple>::value == 0> >
+{
+public:
+    template <typename VT = ValuesTuple>
+    static auto tupleMatchImpl(VT const &, PatternsTuple const &)
+    {
+        return false;
+    }
+};
+
+template <typename ValuesTuple, typename PatternsTuple>
+class TupleMatchHelper<ValuesTuple, PatternsTuple,
+                       std::enable_if_t<isTupleLikeV<ValuesTuple> && isOooHeadV<PatternsTuple> > >
+{
+public:
+    template <typename VT = ValuesTuple>
+    static bool tupleMatchImpl(VT const &values, PatternsTuple const &patterns)
+    {
+        return tryOooMatch(values, patterns);
+    }
+};
+
+template <typename ValuesTuple, typename PatternsTuple>
+class TupleMatchHelper<ValuesTuple, PatternsTuple,
+                       std::enable_if_t<std::tuple_size<ValuesTuple>::value == 0 && std::tuple_size<PatternsTuple>::value == 0> >
+{
+public:
+    template <typename VT = ValuesTuple>
+    static auto tupleMatchImpl(VT const &, PatternsTuple const &)
+    {
+        return true;
+    }
+};
+
+template <typename... Patterns>
+class PatternTraits<Ds<Patterns...> >
+{
+public:
+    template <typename Tuple>
+    static auto matchPatternImpl(Tuple const &valueTuple, Ds<Patterns...> const &dsPat)
+        -> decltype(TupleMatchHelper<Tuple, std::tuple<Patterns...>>::tupleMatchImpl(valueTuple, dsPat.patterns()))
+    {
+        constexpr std::size_t kSIZE = std::tuple_size<Tuple>::value;
+        if constexpr (kSIZE < Ds<Patterns...>::kMIN_SIZE || kSIZE > Ds<Patterns...>::kMAX_SIZE)
+        {
+            return false;
+        }
+        else
+        {
+            return TupleMatchHelper<Tuple, std::tuple<Patterns...>>::tupleMatchImpl(valueTuple, dsPat.patterns());
+        }
+    }
+    template <typename Range>
+    static auto matchPatternImpl(Range const &values, Ds<Patterns...> const &dsPat)
+    -> std::enable_if_t<isRuntimeRangeV<Range> && (MatchFuncDefinedV<decltype(values[0]), typename SegmentPattern<Patterns>::type> && ...), bool>
+    {
+        auto const size = values.size();
+        [[maybe_unused]] auto const part = elementsPart(values);
+        return Ds<Patterns...>::kMIN_SIZE <= size && size <= Ds<Patterns...>::kMAX_SIZE && rangeMatch(values, dsPat.patterns());
+    }
+    static void resetId(Ds<Patterns...> const &dsPat)
+    {
+        return std::apply(
+            [](Patterns const &...patterns) {
+                return (::resetId(patterns), ...);
+            },
+            dsPat.patterns());
+    }
+
+private:
+};
+
+static_assert(isOooV<Ooo<int> > == true);
+static_assert(isOooV<Ooo<int &> > == true);
+static_assert(isOooV<Ooo<int const &> > == true);
+static_assert(isOooV<Ooo<int &&> > == true);
+static_assert(isOooV<int> == false);
+static_assert(isOooV<const Ooo<WildCard> &> == true);
+
+template <typename Tuple, std::size_t... I>
+auto takeImpl(Tuple &&t, std::index_sequence<I...>)
+{
+    using std::get;
+    return std::forward_as_tuple(get<I>(std::forward<Tuple>(t))...);
+}
+
+template <std::size_t N, typename Tuple>
+auto take(Tuple &&t)
+{
+    return takeImpl(
+        std::forward<Tuple>(t),
+        std::make_index_sequence<N>{});
+}
+
+template <typename PatternsTuple, std::size_t... I>
+constexpr std::size_t oooCountImpl(std::index_sequence<I...>)
+{
+    return (std::size_t{isOooV<std::tuple_element_t<I, PatternsTuple> >} + ... + 0);
+}
+
+template <typename PatternsTuple>
+inline constexpr std::size_t oooCountV = oooCountImpl<PatternsTuple>(std::make_index_sequence<std::tuple_size_v<PatternsTuple> >{});
+
+template <typename PatternsTuple>
+inline constexpr bool hasOooV = oooCountV<PatternsTuple> > 0;
+
+// Whether the first of the patterns is ooo(_), false when there are none.
+template <typename PatternsTuple, typename Enable = void>
+inline constexpr bool isWildcardHeadV = false;
+
+template <typename PatternsTuple>
+inline constexpr bool isWildcardHeadV<PatternsTuple, std::enable_if_t<(std::tuple_size<PatternsTuple>::value > 0)> > =
+    std::is_same_v<std::decay_t<std::tuple_element_t<0, PatternsTuple> >, Ooo<WildCard> >;
+
+template <typename PatternsTuple>
+using DropOneT = decltype(drop<1>(std::declval<PatternsTuple const &>()));
+
+// An ooo(_) at the head takes whatever the following patterns leave: it merges with a following ooo(_),
+// and when the following patterns have a fixed size, it ends where they start.
+template <typename PatternsTuple, typename Enable = void>
+inline constexpr bool isWildcardShortcutV = false;
+
+template <typename PatternsTuple>
+inline constexpr bool isWildcardShortcutV<PatternsTuple, std::enable_if_t<isWildcardHeadV<PatternsTuple> > > =
+    isWildcardHeadV<DropOneT<PatternsTuple> > || !hasOooV<DropOneT<PatternsTuple> >;
+
+// The ooo that need a search, the others being taken care of by the shortcut above.
+template <typename PatternsTuple, std::size_t... I>
+constexpr std::size_t searchedOooCountImpl(std::index_sequence<I...>)
+{
+    constexpr std::size_t kSIZE = std::tuple_size_v<PatternsTuple>;
+    return (std::size_t{isOooV<std::tuple_element_t<I, PatternsTuple> > && !isWildcardShortcutV<TupleView<PatternsTuple, I, kSIZE - I> >} + ... + 0);
+}
+
+template <typename PatternsTuple>
+inline constexpr std::size_t searchedOooCountV =
+    searchedOooCountImpl<PatternsTuple>(std::make_index_sequence<std::tuple_size_v<PatternsTuple> >{});
+
+// The lengths the ooo at the head of the patterns can take, from 0 to its maximum, the shorter ones only being checked.
+template <typename ValuesTuple, typename PatternsTuple>
+constexpr auto segmentLengths()
+{
+    constexpr std::size_t kMAX = SegmentSize<std::tuple_element_t<0, PatternsTuple> >::kMAX;
+    return std::make_index_sequence<std::min(std::tuple_size_v<ValuesTuple>, kMAX) + 1>{};
+}
+
+template <typename ValuesTuple, typename PatternsTuple, typename Continue>
+bool wildcardSegmentMatch(ValuesTuple const &values, PatternsTuple const &patterns, Continue const &next)
+{
+    auto const rest = drop<1>(patterns);
+    if constexpr (isWildcardHeadV<DropOneT<PatternsTuple> >)
+    {
+        return next(values, rest);
+    }
+    else
+    {
+        constexpr std::size_t kVALUES = std::tuple_size_v<ValuesTuple>;
+        constexpr std::size_t kREST = std::tuple_size_v<DropOneT<PatternsTuple> >;
+        if constexpr (kVALUES < kREST)
+        {
+            return false;
+        }
+        else
+        {
+            return next(drop<kVALUES - kREST>(values), rest);
+        }
+    }
+}
+
+// Whether the last `values` values can match the last `patterns` patterns, once known.
+template <std::size_t values, std::size_t patterns>
+class SegmentMemo
+{
+public:
+    template <std::size_t v, std::size_t p>
+    std::optional<bool> &at()
+    {
+        static_assert(v <= values && p <= patterns);
+        return mResults[v * (patterns + 1) + p];
+    }
+
+private:
+    std::array<std::optional<bool>, (values + 1) * (patterns + 1)> mResults{};
+};
+
+// Segment matching for patterns without identifiers: the result only depends on how many values and patterns are left,
+// so every such state is computed once and an ooo either ends or takes one more value.
+template <typename ValuesTuple, typename PatternsTuple, typename Memo>
+bool tryOooMatchMemo(ValuesTuple const &values, PatternsTuple const &patterns, Memo &memo)
+{
+    constexpr std::size_t kVALUES = std::tuple_size_v<ValuesTuple>;
+    constexpr std::size_t kPATTERNS = std::tuple_size_v<PatternsTuple>;
+    if constexpr (kPATTERNS == 0)
+    {
+        return kVALUES == 0;
+    }
+    else if constexpr (isWildcardShortcutV<PatternsTuple>)
+    {
+        return wildcardSegmentMatch(values, patterns, [&memo](auto const &v, auto const &p) { return tryOooMatchMemo(v, p, memo); });
+    }
+    else if constexpr (isOooV<std::tuple_element_t<0, PatternsTuple> > && !isPlainOooV<std::tuple_element_t<0, PatternsTuple> >)
+    {
+        // Bounded segments and segments with a length pattern try each allowed length in turn.
+        auto &result = memo.template at<kVALUES, kPATTERNS>();
+        if (!result.has_value())
+        {
+            result = tryOooMatchImpl(values, patterns, [&memo](auto const &v, auto const &p) { return tryOooMatchMemo(v, p, memo); },
+                                     segmentLengths<ValuesTuple, PatternsTuple>());
+        }
+        return *result;
+    }
+    else if constexpr (isOooV<std::tuple_element_t<0, PatternsTuple> >)
+    {
+        auto &result = memo.template at<kVALUES, kPATTERNS>();
+        if (!result.has_value())
+        {
+            bool matched = tryOooMatchMemo(values, drop<1>(patterns), memo);
+            if constexpr (kVALUES > 0)
+            {
+                if constexpr (MatchFuncDefinedV<decltype(take<1>(values)), std::tuple_element_t<0, PatternsTuple> >)
+                {
+                    matched = matched ||
+                              (PatternTraits<std::tuple_element_t<0, PatternsTuple> >::matchPatternImplSingle(get<0>(values), get<0>(patterns)) &&
+                               tryOooMatchMemo(drop<1>(values), patterns, memo));
+                }
+            }
+            result = matched;
+        }
+        return *result;
+    }
+    else if constexpr (kVALUES >= 1)
+    {
+        if constexpr (MatchFuncDefinedV<std::tuple_element_t<0, ValuesTuple>, std::tuple_element_t<0, PatternsTuple> >)
+        {
+            return ::matchPattern(get<0>(values), get<0>(patterns)) && tryOooMatchMemo(drop<1>(values), drop<1>(patterns), memo);
+        }
+    }
+    return false;
+}
+
+template <typename ValuesTuple, typename PatternsTuple>
+bool tryOooMatch(ValuesTuple const &values, PatternsTuple const &patterns)
+{
+    if constexpr (isWildcardShortcutV<PatternsTuple>)
+    {
+        return wildcardSegmentMatch(values, patterns, [](auto const &v, auto const &p) { return tryOooMatch(v, p); });
+    }
+    else if constexpr (hasOooV<PatternsTuple> && IsIdFree<PatternsTuple>::value)
+    {
+        SegmentMemo<std::tuple_size_v<ValuesTuple>, std::tuple_size_v<PatternsTuple> > memo;
+        return tryOooMatchMemo(values, patterns, memo);
+    }
+    else if constexpr (std::tuple_size_v<PatternsTuple> == 0)
+    {
+        return std::tuple_size_v<ValuesTuple> == 0;
+    }
+    else if constexpr (isOooV<std::tuple_element_t<0, PatternsTuple> >)
+    {
+        return tryOooMatchImpl(values, patterns, [](auto const &v, auto const &p) { return tryOooMatch(v, p); },
+                               segmentLengths<ValuesTuple, PatternsTuple>());
+    }
+    else if constexpr (std::tuple_size_v<ValuesTuple> >= 1)
+    {
+        if constexpr (MatchFuncDefinedV<std::tuple_element_t<0, ValuesTuple>, std::tuple_element_t<0, PatternsTuple> >)
+        {
+            return ::matchPattern(get<0>(values), get<0>(patterns)) && tryOooMatch(drop<1>(values), drop<1>(patterns));
+        }
+    }
+    return false;
+}
+
+// Whether the ooo at the head of the patterns matches the value at index I.
+template <std::size_t I, typename ValuesTuple, typename PatternsTuple>
+bool oooElementMatch(ValuesTuple const &values, PatternsTuple const &patterns)
+{
+    using std::get;
+    using Segment = std::tuple_element_t<0, PatternsTuple>;
+    if constexpr (I < std::tuple_size_v<ValuesTuple>)
+    {
+        if constexpr (MatchFuncDefinedV<decltype(take<I + 1>(values)), Segment>)
+        {
+            return PatternTraits<Segment>::matchPatternImplSingle(get<I>(values), get<0>(patterns));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+}
+
+// Takes the first I values, already matched, as the segment of the ooo at the head of the patterns, and the other
+// patterns on the rest with next.
+template <std::size_t I, typename ValuesTuple, typename PatternsTuple, typename Continue>
+bool tryOooLength(ValuesTuple const &values, PatternsTuple const &patterns, Continue const &next)
+{
+    using std::get;
+    using Segment = std::tuple_element_t<0, PatternsTuple>;
+    constexpr std::size_t kREST = std::tuple_size_v<PatternsTuple> - 1;
+    if constexpr (I < SegmentSize<Segment>::kMIN)
+    {
+        return false;
+    }
+    else if constexpr (!hasOooV<DropOneT<PatternsTuple> > && I + kREST != std::tuple_size_v<ValuesTuple>)
+    {
+        // The patterns left take a fixed number of values, so the segment can only end in one place.
+        return false;
+    }
+    else
+    {
+        return tryAlternative<PatternsTuple>(
+            [&] { return PatternTraits<Segment>::matchLength(I, get<0>(patterns)) && next(drop<I>(values), drop<1>(patterns)); });
+    }
+}
+
+// Tries the ooo at the head of the patterns on the first I values. Sets stop when no longer segment can match.
+template <std::size_t I, typename ValuesTuple, typename PatternsTuple, typename Continue>
+bool tryOooMatchImplHelper(ValuesTuple const &values, PatternsTuple const &patterns, bool &stop, Continue const &next)
+{
+    if constexpr (I > 0)
+    {
+        if (!oooElementMatch<I - 1>(values, patterns))
+        {
+            stop = true;
+            return false;
+        }
+    }
+    return tryOooLength<I>(values, patterns, next);
+}
+
+// Takes the first I values, out of a run measured beforehand, as the segment of the ooo at the head of the patterns.
+// The bindings made while measuring are gone, so a segment with identifiers matches the I values again.
+template <std::size_t I, typename ValuesTuple, typename PatternsTuple, typename Continue, std::size_t... J>
+bool tryOooRun(ValuesTuple const &values, PatternsTuple const &patterns, Continue const &next, std::index_sequence<J...>)
+{
+    if constexpr (IsIdFree<std::tuple<std::tuple_element_t<0, PatternsTuple> > >::value)
+    {
+        return tryOooLength<I>(values, patterns, next);
+    }
+    else
+    {
+        return tryAlternative<PatternsTuple>(
+            [&] { return (oooElementMatch<J>(values, patterns) && ...) && tryOooLength<I>(values, patterns, next); });
+    }
+}
+
+// Lazy segments grow one value at a time. Greedy and possessive ones first find the longest run of values they match,
+// then try it shrinking, or only it.
+template <typename ValuesTuple, typename PatternsTuple, typename Continue, std::size_t... I>
+bool tryOooMatchImpl(ValuesTuple const &values, PatternsTuple const &patterns, Continue const &next, std::index_sequence<I...>)
+{
+    constexpr SegmentMode kMODE = SegmentSize<std::tuple_element_t<0, PatternsTuple> >::kMODE;
+    if constexpr (kMODE == SegmentMode::kLAZY)
+    {
+        bool stop = false;
+        return ((!stop && tryOooMatchImplHelper<I>(values, patterns, stop, next)) || ...);
+    }
+    else
+    {
+        constexpr std::size_t kLAST = sizeof...(I) - 1;
+        std::size_t run = 0;
+        {
+            // Measuring binds the identifiers of the segment to the whole run, which no shorter length may see.
+            BindingTrail::Checkpoint const checkpoint;
+            ((I < kLAST && run == I && oooElementMatch<I>(values, patterns) && ++run), ...);
+            checkpoint.rollback();
+        }
+        if constexpr (kMODE == SegmentMode::kGREEDY)
+        {
+            return ((kLAST - I <= run && tryOooRun<kLAST - I>(values, patterns, next, std::make_index_sequence<kLAST - I>{})) || ...);
+        }
+        else
+        {
+            return ((I == run && tryOooRun<I>(values, patterns, next, std::make_index_sequence<I>{})) || ...);
+        }
+    }
+}
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class Ooo
+{
+    static_assert(minSize <= maxSize);
+
+public:
+    explicit Ooo(Pattern const &pattern, Length const &length = Length{})
+        : mPattern{pattern}, mLength{length}
+    {
+    }
+    auto const &pattern() const
+    {
+        return mPattern;
+    }
+    auto const &length() const
+    {
+        return mLength;
+    }
+
+private:
+    Pattern mPattern;
+    Length mLength;
+};
+
+template <typename Pattern>
+auto ooo(Pattern const &pattern)
+{
+    return Ooo<Pattern>{pattern};
+}
+
+// A segment of at least minSize and at most maxSize values.
+template <std::size_t minSize, std::size_t maxSize = kUNBOUNDED, typename Pattern>
+auto ooo(Pattern const &pattern)
+{
+    return Ooo<Pattern, minSize, maxSize>{pattern};
+}
+
+// A segment whose length is matched against a pattern, typically an Id<std::size_t> binding it.
+template <typename Pattern, typename Length>
+auto oon(Pattern const &pattern, Length const &length)
+{
+    return Ooo<Pattern, 0, kUNBOUNDED, Length>{pattern, length};
+}
+
+template <std::size_t minSize, std::size_t maxSize = kUNBOUNDED, typename Pattern, typename Length>
+auto oon(Pattern const &pattern, Length const &length)
+{
+    return Ooo<Pattern, minSize, maxSize, Length>{pattern, length};
+}
+
+// A segment trying the longest run of values first.
+template <std::size_t minSize = 0, std::size_t maxSize = kUNBOUNDED, typename Pattern>
+auto ooo_greedy(Pattern const &pattern)
+{
+    return Ooo<Pattern, minSize, maxSize, WildCard, SegmentMode::kGREEDY>{pattern};
+}
+
+// A segment taking the longest run of values and never giving any back, so the patterns before it are not retried.
+template <std::size_t minSize = 0, std::size_t maxSize = kUNBOUNDED, typename Pattern>
+auto ooo_possessive(Pattern const &pattern)
+{
+    return Ooo<Pattern, minSize, maxSize, WildCard, SegmentMode::kPOSSESSIVE>{pattern};
+}
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class PatternTraits<Ooo<Pattern, minSize, maxSize, Length, mode> >
+{
+    using OooT = Ooo<Pattern, minSize, maxSize, Length, mode>;
+
+public:
+    template <typename... Values>
+    static auto matchPatternImpl(std::tuple<Values...> const &valueTuple, OooT const &oooPat)
+    -> decltype((::matchPattern(std::declval<Values>(), oooPat.pattern()) && ...) && ::matchPattern(std::size_t{}, oooPat.length()))
+    {
+        constexpr std::size_t kSIZE = sizeof...(Values);
+        if constexpr (kSIZE < minSize || kSIZE > maxSize)
+        {
+            return false;
+        }
+        else
+        {
+            return std::apply(
+                       [&oooPat](Values const &...values) {
+                           auto result = (::matchPattern(values, oooPat.pattern()) && ...);
+                           return result;
+                       },
+                       valueTuple) &&
+                   matchLength(kSIZE, oooPat);
+        }
+    }
+    template <typename Value>
+    static auto matchPatternImplSingle(Value const &value, OooT const &oooPat)
+    -> decltype(::matchPattern(value, oooPat.pattern()))
+    {
+        return ::matchPattern(value, oooPat.pattern());
+    }
+    // Whether a segment of the given length, already within the bounds, is accepted by the length pattern.
+    static bool matchLength(std::size_t length, OooT const &oooPat)
+    {
+        return ::matchPattern(length, oooPat.length());
+    }
+    static void resetId(OooT const &oooPat)
+    {
+        ::resetId(oooPat.pattern());
+        ::resetId(oooPat.length());
+    }
+};
+
+// Bounds an element can be compared against several lanes at a time, with the same result as the scalar comparison.
+template <typename Element, typename Bound>
+inline constexpr bool isSimdBoundV =
+    (std::is_same_v<Element, std::int32_t> && std::is_same_v<Bound, std::int32_t>) ||
+    (std::is_same_v<Element, float> && (std::is_same_v<Bound, float> || std::is_same_v<Bound, std::int32_t>));
+
+// Subpatterns of an ooo that are a single comparison against a bound: a literal or a relation.
+template <typename Element, typename Pattern, typename Enable = void>
+class SimdSegment : public std::false_type
+{
+};
+
+template <typename Element, typename Pattern>
+class SimdSegment<Element, Pattern, std::enable_if_t<isSimdBoundV<Element, Pattern> > > : public std::true_type
+{
+public:
+    using Op = std::equal_to<>;
+    static Element bound(Pattern const &literal)
+    {
+        return static_cast<Element>(literal);
+    }
+};
+
+template <typename Element, typename RelationOp, typename T>
+class SimdSegment<Element, Relation<RelationOp, T>, std::enable_if_t<isSimdBoundV<Element, T> > > : public std::true_type
+{
+public:
+    using Op = RelationOp;
+    static Element bound(Relation<RelationOp, T> const &relation)
+    {
+        return static_cast<Element>(relation.bound());
+    }
+};
+
+#if defined(__AVX2__)
+// Bit i is set when lane i passes the comparison.
+template <typename Op>
+int simdPassMask(__m256i lanes, __m256i bound)
+{
+    auto const bits = [](__m256i mask) { return _mm256_movemask_ps(_mm256_castsi256_ps(mask)); };
+    if constexpr (std::is_same_v<Op, std::equal_to<> >)
+    {
+        return bits(_mm256_cmpeq_epi32(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less<> >)
+    {
+        return bits(_mm256_cmpgt_epi32(bound, lanes));
+    }
+    else if constexpr (std::is_same_v<Op, std::greater<> >)
+    {
+        return bits(_mm256_cmpgt_epi32(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less_equal<> >)
+    {
+        return 0xFF & ~bits(_mm256_cmpgt_epi32(lanes, bound));
+    }
+    else
+    {
+        return 0xFF & ~bits(_mm256_cmpgt_epi32(bound, lanes));
+    }
+}
+
+template <typename Op>
+int simdPassMask(__m256 lanes, __m256 bound)
+{
+    if constexpr (std::is_same_v<Op, std::equal_to<> >)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, bound, _CMP_EQ_OQ));
+    }
+    else if constexpr (std::is_same_v<Op, std::less<> >)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, bound, _CMP_LT_OQ));
+    }
+    else if constexpr (std::is_same_v<Op, std::greater<> >)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, bound, _CMP_GT_OQ));
+    }
+    else if constexpr (std::is_same_v<Op, std::less_equal<> >)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, bound, _CMP_LE_OQ));
+    }
+    else
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, bound, _CMP_GE_OQ));
+    }
+}
+#elif defined(__SSE2__)
+// Bit i is set when lane i passes the comparison.
+template <typename Op>
+int simdPassMask(__m128i lanes, __m128i bound)
+{
+    auto const bits = [](__m128i mask) { return _mm_movemask_ps(_mm_castsi128_ps(mask)); };
+    if constexpr (std::is_same_v<Op, std::equal_to<> >)
+    {
+        return bits(_mm_cmpeq_epi32(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less<> >)
+    {
+        return bits(_mm_cmplt_epi32(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::greater<> >)
+    {
+        return bits(_mm_cmpgt_epi32(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less_equal<> >)
+    {
+        return 0xF & ~bits(_mm_cmpgt_epi32(lanes, bound));
+    }
+    else
+    {
+        return 0xF & ~bits(_mm_cmplt_epi32(lanes, bound));
+    }
+}
+
+template <typename Op>
+int simdPassMask(__m128 lanes, __m128 bound)
+{
+    if constexpr (std::is_same_v<Op, std::equal_to<> >)
+    {
+        return _mm_movemask_ps(_mm_cmpeq_ps(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less<> >)
+    {
+        return _mm_movemask_ps(_mm_cmplt_ps(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::greater<> >)
+    {
+        return _mm_movemask_ps(_mm_cmpgt_ps(lanes, bound));
+    }
+    else if constexpr (std::is_same_v<Op, std::less_equal<> >)
+    {
+        return _mm_movemask_ps(_mm_cmple_ps(lanes, bound));
+    }
+    else
+    {
+        return _mm_movemask_ps(_mm_cmpge_ps(lanes, bound));
+    }
+}
+#endif
+
+// The end of the run of elements from begin passing the comparison against the bound, several lanes at a time.
+template <typename Op, typename Element>
+std::size_t simdSegmentEnd(Element const *data, std::size_t begin, std::size_t size, Element bound)
+{
+    std::size_t i = begin;
+#if defined(__AVX2__)
+    constexpr std::size_t kLANES = 8;
+    for (; i + kLANES <= size; i += kLANES)
+    {
+        int mask = 0;
+        if constexpr (std::is_same_v<Element, float>)
+        {
+            mask = simdPassMask<Op>(_mm256_loadu_ps(data + i), _mm256_set1_ps(bound));
+        }
+        else
+        {
+            mask = simdPassMask<Op>(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i)), _mm256_set1_epi32(bound));
+        }
+        if (mask != 0xFF)
+        {
+            return i + __builtin_ctz(static_cast<unsigned>(~mask));
+        }
+    }
+#elif defined(__SSE2__)
+    constexpr std::size_t kLANES = 4;
+    for (; i + kLANES <= size; i += kLANES)
+    {
+        int mask = 0;
+        if constexpr (std::is_same_v<Element, float>)
+        {
+            mask = simdPassMask<Op>(_mm_loadu_ps(data + i), _mm_set1_ps(bound));
+        }
+        else
+        {
+            mask = simdPassMask<Op>(_mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i)), _mm_set1_epi32(bound));
+        }
+        if (mask != 0xF)
+        {
+            return i + __builtin_ctz(static_cast<unsigned>(~mask));
+        }
+    }
+#endif
+    for (; i < size && Op{}(data[i], bound); ++i)
+    {
+    }
+    return i;
+}
+
+// The end of the longest run of elements from begin, up to last, that the subpattern of an ooo matches.
+template <typename Range, typename Pattern>
+std::size_t segmentEnd(Range const &values, std::size_t begin, std::size_t last, Pattern const &pattern)
+{
+    using Element = std::decay_t<decltype(values[0])>;
+    if constexpr (std::is_same_v<Pattern, WildCard>)
+    {
+        return last;
+    }
+    else if constexpr (SimdSegment<Element, Pattern>::value)
+    {
+        using Segment = SimdSegment<Element, Pattern>;
+        return simdSegmentEnd<typename Segment::Op>(std::data(values), begin, last, Segment::bound(pattern));
+    }
+    else
+    {
+        std::size_t end = begin;
+        for (; end < last && ::matchPattern(values[end], pattern); ++end)
+        {
+        }
+        return end;
+    }
+}
+
+template <std::size_t I, typename PatternsTuple, typename Element>
+std::uint64_t rangeStepAt(Element const &value, PatternsTuple const &patterns)
+{
+    using Pattern = std::tuple_element_t<I, PatternsTuple>;
+    if constexpr (isOooV<Pattern>)
+    {
+        return PatternTraits<Pattern>::matchPatternImplSingle(value, std::get<I>(patterns)) ? std::uint64_t{1} << I : 0;
+    }
+    else
+    {
+        return ::matchPattern(value, std::get<I>(patterns)) ? std::uint64_t{1} << (I + 1) : 0;
+    }
+}
+
+// The positions reached from the given ones by consuming one element.
+template <typename PatternsTuple, typename Element, std::size_t... I>
+std::uint64_t rangeStep(Element const &value, PatternsTuple const &patterns, std::uint64_t positions, std::index_sequence<I...>)
+{
+    std::uint64_t next = 0;
+    ((next |= (positions >> I & 1) != 0 ? rangeStepAt<I>(value, patterns) : 0), ...);
+    return next;
+}
+
+// Adds the positions reached by ending an ooo without consuming anything.
+template <typename PatternsTuple, std::size_t... I>
+std::uint64_t rangeClosure(std::uint64_t positions, std::index_sequence<I...>)
+{
+    ((positions |= isOooV<std::tuple_element_t<I, PatternsTuple> > && (positions >> I & 1) != 0 ? std::uint64_t{1} << (I + 1) : 0), ...);
+    return positions;
+}
+
+// Tries the shortest segment first for an ooo, as for tuples.
+template <std::size_t I, typename Range, typename PatternsTuple>
+bool rangeMatchFrom(Range const &values, std::size_t position, PatternsTuple const &patterns)
+{
+    if constexpr (I == std::tuple_size_v<PatternsTuple>)
+    {
+        return position == values.size();
+    }
+    else if constexpr (isWildcardHeadV<TupleView<PatternsTuple, I, std::tuple_size_v<PatternsTuple> - I> > &&
+                       isWildcardHeadV<TupleView<PatternsTuple, I + 1, std::tuple_size_v<PatternsTuple> - I - 1> >)
+    {
+        // Adjacent ooo(_) match the same as one.
+        return rangeMatchFrom<I + 1>(values, position, patterns);
+    }
+    else if constexpr (isOooV<std::tuple_element_t<I, PatternsTuple> > &&
+                       SegmentSize<std::tuple_element_t<I, PatternsTuple> >::kMODE != SegmentMode::kLAZY)
+    {
+        // The longest run is found first, then tried shrinking, or only it for a possessive segment.
+        using Segment = std::tuple_element_t<I, PatternsTuple>;
+        constexpr std::size_t kMIN = SegmentSize<Segment>::kMIN;
+        constexpr std::size_t kMAX = SegmentSize<Segment>::kMAX;
+        constexpr std::size_t kREST = std::tuple_size_v<PatternsTuple> - I - 1;
+        constexpr bool kFIXED_REST = !hasOooV<TupleView<PatternsTuple, I + 1, kREST> >;
+        constexpr bool kID_FREE = IsIdFree<std::tuple<Segment> >::value;
+        auto const &segment = std::get<I>(patterns);
+        std::size_t const last = values.size() - position <= kMAX ? values.size() : position + kMAX;
+        std::size_t limit = 0;
+        {
+            // The bindings made while measuring are undone, a segment with identifiers matches each length again.
+            BindingTrail::Checkpoint const checkpoint;
+            limit = segmentEnd(values, position, last, segment.pattern());
+            checkpoint.rollback();
+        }
+        if (limit < position + kMIN)
+        {
+            return false;
+        }
+        std::size_t const shortest = SegmentSize<Segment>::kMODE == SegmentMode::kPOSSESSIVE ? limit : position + kMIN;
+        for (std::size_t end = limit + 1; end-- > shortest;)
+        {
+            if ((!kFIXED_REST || end + kREST == values.size()) &&
+                tryAlternative<TupleView<PatternsTuple, I, kREST + 1> >([&] {
+                    return (kID_FREE || segmentEnd(values, position, end, segment.pattern()) == end) &&
+                           PatternTraits<Segment>::matchLength(end - position, segment) && rangeMatchFrom<I + 1>(values, end, patterns);
+                }))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    else if constexpr (isOooV<std::tuple_element_t<I, PatternsTuple> > &&
+                       IsIdFree<std::tuple<std::tuple_element_t<I, PatternsTuple> > >::value)
+    {
+        // The subpattern binds nothing, so the longest run it matches can be found first.
+        using Segment = std::tuple_element_t<I, PatternsTuple>;
+        constexpr std::size_t kMIN = SegmentSize<Segment>::kMIN;
+        constexpr std::size_t kMAX = SegmentSize<Segment>::kMAX;
+        auto const &segment = std::get<I>(patterns);
+        std::size_t const last = values.size() - position <= kMAX ? values.size() : position + kMAX;
+        std::size_t const limit = segmentEnd(values, position, last, segment.pattern());
+        constexpr std::size_t kREST = std::tuple_size_v<PatternsTuple> - I - 1;
+        if constexpr (!hasOooV<TupleView<PatternsTuple, I + 1, kREST> >)
+        {
+            // The patterns left take a fixed number of elements, so the segment can only end in one place.
+            if (values.size() < kREST || values.size() - kREST < position + kMIN || values.size() - kREST > limit)
+            {
+                return false;
+            }
+            return PatternTraits<Segment>::matchLength(values.size() - kREST - position, segment) &&
+                   rangeMatchFrom<I + 1>(values, values.size() - kREST, patterns);
+        }
+        else
+        {
+            for (std::size_t end = position + kMIN; end <= limit; ++end)
+            {
+                if (tryAlternative<TupleView<PatternsTuple, I, kREST + 1> >([&] {
+                        return PatternTraits<Segment>::matchLength(end - position, segment) &&
+                               rangeMatchFrom<I + 1>(values, end, patterns);
+                    }))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+    else if constexpr (isOooV<std::tuple_element_t<I, PatternsTuple> >)
+    {
+        using Segment = std::tuple_element_t<I, PatternsTuple>;
+        constexpr std::size_t kREST = std::tuple_size_v<PatternsTuple> - I - 1;
+        constexpr bool kFIXED_REST = !hasOooV<TupleView<PatternsTuple, I + 1, kREST> >;
+        auto const &segment = std::get<I>(patterns);
+        for (std::size_t end = position;; ++end)
+        {
+            std::size_t const length = end - position;
+            if (length >= SegmentSize<Segment>::kMIN && (!kFIXED_REST || end + kREST == values.size()) &&
+                tryAlternative<TupleView<PatternsTuple, I, kREST + 1> >([&] {
+                    return PatternTraits<Segment>::matchLength(length, segment) && rangeMatchFrom<I + 1>(values, end, patterns);
+                }))
+            {
+                return true;
+            }
+            if (length == SegmentSize<Segment>::kMAX || end == values.size() ||
+                !PatternTraits<Segment>::matchPatternImplSingle(values[end], segment))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        return position < values.size() && ::matchPattern(values[position], std::get<I>(patterns)) &&
+               rangeMatchFrom<I + 1>(values, position + 1, patterns);
+    }
+}
+
+// Matches a range in one pass over its elements. Without identifiers, the order in which patterns are tried does not matter,
+// so several ooo are run as an automaton whose states are the positions in the pattern list, kept in a bit mask.
+// With at most one ooo needing a search, the search is already linear. Bounded ooo count their elements, which the
+// automaton does not, so they are searched.
+template <typename Range, typename... Patterns>
+bool rangeMatch(Range const &values, std::tuple<Patterns...> const &patterns)
+{
+    using PatternsTuple = std::tuple<Patterns...>;
+    constexpr bool kPLAIN = ((!isOooV<Patterns> || isPlainOooV<Patterns>) && ...);
+    if constexpr (searchedOooCountV<PatternsTuple> > 1 && sizeof...(Patterns) < 64 && kPLAIN && IsIdFree<PatternsTuple>::value)
+    {
+        constexpr auto index = std::index_sequence_for<Patterns...>{};
+        std::uint64_t positions = rangeClosure<PatternsTuple>(1, index);
+        for (auto const &value : values)
+        {
+            positions = rangeClosure<PatternsTuple>(rangeStep(value, patterns, positions, index), index);
+            if (positions == 0)
+            {
+                return false;
+            }
+        }
+        return (positions >> sizeof...(Patterns) & 1) != 0;
+    }
+    else
+    {
+        return rangeMatchFrom<0>(values, 0, patterns);
+    }
+}
+
+template <typename Pattern, typename Pred>
+class PostCheck
+{
+public:
+    explicit PostCheck(Pattern const &pattern, Pred const &pred)
+        : mPattern{pattern}, mPred{pred}
+    {
+    }
+    bool check() const
+    {
+        return mPred();
+    }
+    auto const &pattern() const
+    {
+        return mPattern;
+    }
+
+private:
+    Pattern const mPattern;
+    Pred const mPred;
+};
+
+template <typename Pattern, typename Pred>
+class PatternTraits<PostCheck<Pattern, Pred> >
+{
+public:
+    template <typename Value>
+    static auto matchPatternImpl(Value const &value, PostCheck<Pattern, Pred> const &postCheck)
+    -> decltype(::matchPattern(value, postCheck.pattern()) && postCheck.check())
+    {
+        return ::matchPattern(value, postCheck.pattern()) && postCheck.check();
+    }
+    static void resetId(PostCheck<Pattern, Pred> const &postCheck)
+    {
+        ::resetId(postCheck.pattern());
+    }
+};
+
+// Literals whose equality test is cheap and free of side effects.
+template <typename Pattern>
+class IsLiteral : public std::bool_constant<std::is_arithmetic_v<Pattern> || std::is_enum_v<Pattern> >
+{
+};
+
+template <typename Pattern>
+inline constexpr bool isLiteralV = IsLiteral<std::decay_t<Pattern> >::value;
+
+// Column view of an arm used by the decision tree.
+// Arms other than flat Ds patterns of the same arity and WildCard are opaque.
+template <typename Pattern, std::size_t size, typename Enable = void>
+class ArmColumns : public std::false_type
+{
+};
+
+template <std::size_t size>
+class ArmColumns<WildCard, size> : public std::true_type
+{
+public:
+    template <std::size_t I>
+    static constexpr bool isLiteral()
+    {
+        return false;
+    }
+    template <typename Value>
+    static bool matchRest(Value const &, WildCard const &)
+    {
+        return true;
+    }
+};
+
+template <typename... Patterns>
+class ArmColumns<Ds<Patterns...>, sizeof...(Patterns), std::enable_if_t<!(isOooV<Patterns> || ...)> > : public std::true_type
+{
+public:
+    template <std::size_t I>
+    static constexpr bool isLiteral()
+    {
+        return isLiteralV<std::tuple_element_t<I, std::tuple<Patterns...> > >;
+    }
+    template <typename Value>
+    static bool matchRest(Value const &value, Ds<Patterns...> const &dsPat)
+    {
+        return tryAlternative<std::tuple<Patterns...> >([&value, &dsPat] { return matchRestImpl(value, dsPat, std::index_sequence_for<Patterns...>{}); });
+    }
+
+private:
+    template <typename Value, std::size_t... I>
+    static bool matchRestImpl(Value const &value, Ds<Patterns...> const &dsPat, std::index_sequence<I...>)
+    {
+        return ((isLiteral<I>() || ::matchPattern(get<I>(value), get<I>(dsPat.patterns()))) && ...);
+    }
+};
+
+template <typename Arm, std::size_t size>
+using ArmColumnsT = ArmColumns<std::decay_t<decltype(std::declval<Arm>().pattern())>, size>;
+
+template <typename Value, typename Arms>
+class IsDecisionTreeApplicable : public std::false_type
+{
+};
+
+template <typename Value, typename... Arms>
+class IsDecisionTreeApplicable<Value, std::tuple<Arms...> >
+{
+    template <std::size_t... C>
+    static constexpr bool hasLiteralColumn(std::index_sequence<C...>)
+    {
+        auto const armHasLiteral = [](auto columns) {
+            using Columns = decltype(columns);
+            if constexpr (Columns::value)
+            {
+                return (Columns::template isLiteral<C>() || ...);
+            }
+            else
+            {
+                return false;
+            }
+        };
+        return (armHasLiteral(ArmColumnsT<Arms, sizeof...(C)>{}) || ...);
+    }
+
+public:
+    static constexpr bool value = [] {
+        if constexpr (isTupleLikeV<Value> && sizeof...(Arms) <= 64)
+        {
+            constexpr auto size = std::tuple_size_v<std::decay_t<Value> >;
+            return hasLiteralColumn(std::make_index_sequence<size>{});
+        }
+        else
+        {
+            return false;
+        }
+    }();
+};
+
+// Tries the arms one by one, returns the index of the first matched arm, sizeof...(Arms) if none.
+template <typename Value, typename Arms, typename Enable>
+class ArmsMatchHelper
+{
+public:
+    static std::size_t firstMatch(Value const &value, Arms const &arms)
+    {
+        return std::apply(
+            [&value](auto const &...arms) {
+                std::size_t index = 0;
+                ((arms.matchValue(value) || (++index, false)) || ...);
+                return index;
+            },
+            arms);
+    }
+};
+
+// Decision tree for tuple values.
+// The tree is evaluated column by column: each scrutinee element is loaded once and compared against
+// the literals all arms hold in that column, clearing the arms that fail from a bit mask.
+// Then the first surviving arm is confirmed on its remaining non-literal columns, which keeps the first-match semantics.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<IsDecisionTreeApplicable<Value, std::tuple<Arms...> >::value> >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    static constexpr std::size_t kSIZE = std::tuple_size_v<std::decay_t<Value> >;
+    using Mask = std::uint64_t;
+
+public:
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
+    {
+        auto const armIndices = std::index_sequence_for<Arms...>{};
+        Mask live = liveArms(value, arms, armIndices, std::make_index_sequence<kSIZE>{});
+        return confirm(value, arms, live, armIndices);
+    }
+
+private:
+    template <std::size_t... A, std::size_t... C>
+    static Mask liveArms(Value const &value, ArmsTuple const &arms, std::index_sequence<A...> armIndices, std::index_sequence<C...>)
+    {
+        Mask live = ~Mask{};
+        ((live &= columnMask<C>(get<C>(value), arms, armIndices)), ...);
+        return live;
+    }
+
+    template <std::size_t C, typename Element, std::size_t... A>
+    static Mask columnMask(Element const &element, ArmsTuple const &arms, std::index_sequence<A...>)
+    {
+        return (literalMismatch<C, A>(element, std::get<A>(arms)) | ... | Mask{}) ^ ~Mask{};
+    }
+
+    template <std::size_t C, std::size_t A, typename Element, typename Arm>
+    static Mask literalMismatch(Element const &element, Arm const &arm)
+    {
+        using Columns = ArmColumnsT<Arm, kSIZE>;
+        if constexpr (Columns::value)
+        {
+            if constexpr (Columns::template isLiteral<C>())
+            {
+                return Mask{!::matchPattern(element, get<C>(arm.pattern().patterns()))} << A;
+            }
+        }
+        return 0;
+    }
+
+    template <std::size_t... A>
+    static std::size_t confirm(Value const &value, ArmsTuple const &arms, Mask live, std::index_sequence<A...>)
+    {
+        std::size_t index = 0;
+        (((((live >> A) & 1U) && confirmArm(value, std::get<A>(arms))) || (++index, false)) || ...);
+        return index;
+    }
+
+    template <typename Arm>
+    static bool confirmArm(Value const &value, Arm const &arm)
+    {
+        using Columns = ArmColumnsT<Arm, kSIZE>;
+        if constexpr (Columns::value)
+        {
+            return Columns::matchRest(value, arm.pattern());
+        }
+        else
+        {
+            return arm.matchValue(value);
+        }
+    }
+};
+
+// Integral literals that compare like 32-bit integers after promotion.
+template <typename Pattern>
+class IsSmallIntLiteral : public std::bool_constant<std::is_integral_v<Pattern> && sizeof(Pattern) <= sizeof(std::uint32_t)>
+{
+};
+
+template <typename... Patterns>
+class IsSmallIntLiteral<Or<Patterns...> > : public std::bool_constant<(IsSmallIntLiteral<Patterns>::value && ...)>
+{
+};
+
+template <typename Pattern>
+class LiteralCount : public std::integral_constant<std::size_t, 1>
+{
+};
+
+template <typename... Patterns>
+class LiteralCount<Or<Patterns...> > : public std::integral_constant<std::size_t, (LiteralCount<Patterns>::value + ...)>
+{
+};
+
+template <typename Arm>
+using ArmPatternT = std::decay_t<decltype(std::declval<Arm>().pattern())>;
+
+template <typename Arm>
+inline constexpr bool isLiteralArmV = IsSmallIntLiteral<ArmPatternT<Arm> >::value;
+
+template <typename Arm>
+inline constexpr std::size_t literalCountV = isLiteralArmV<Arm> ? LiteralCount<ArmPatternT<Arm> >::value : 0;
+
+template <typename Value, typename... Arms>
+inline constexpr bool isLiteralTableApplicableV =
+    IsSmallIntLiteral<std::decay_t<Value> >::value && (literalCountV<Arms> + ... + 0) >= 4;
+
+// The literals of a list of arms together with the arm holding each, padded to a whole number of SIMD lanes.
+template <typename... Arms>
+class LiteralTable
+{
+    static constexpr std::size_t kLANES = 4;
+    static constexpr std::size_t kLITERALS = (literalCountV<Arms> + ... + 0);
+    static constexpr std::size_t kPADDED = (kLITERALS + kLANES - 1) / kLANES * kLANES;
+
+public:
+    template <typename ArmsTuple>
+    explicit LiteralTable(ArmsTuple const &arms)
+    {
+        fill(arms, std::index_sequence_for<Arms...>{});
+        if constexpr (kLITERALS > 0)
+        {
+            // Pad with the last literal, any hit there is preceded by the real one.
+            for (std::size_t i = mSize; i < kPADDED; ++i)
+            {
+                mLiterals[i] = mLiterals[kLITERALS - 1];
+                mArms[i] = mArms[kLITERALS - 1];
+            }
+        }
+    }
+
+    // The arm of the first literal equal to the value, or the number of arms.
+    std::size_t lookup(std::uint32_t value) const
+    {
+#if defined(__SSE2__)
+        __m128i const key = _mm_set1_epi32(static_cast<int>(value));
+        for (std::size_t i = 0; i < kPADDED; i += kLANES)
+        {
+            __m128i const lanes = _mm_load_si128(reinterpret_cast<__m128i const *>(mLiterals.data() + i));
+            int const mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lanes, key)));
+            if (mask != 0)
+            {
+                return mArms[i + __builtin_ctz(static_cast<unsigned>(mask))];
+            }
+        }
+#else
+        for (std::size_t i = 0; i < kLITERALS; ++i)
+        {
+            if (mLiterals[i] == value)
+            {
+                return mArms[i];
+            }
+        }
+#endif
+        return sizeof...(Arms);
+    }
+
+private:
+    template <typename ArmsTuple, std::size_t... A>
+    void fill(ArmsTuple const &arms, std::index_sequence<A...>)
+    {
+        (push(std::get<A>(arms).pattern(), A), ...);
+    }
+    template <typename Pattern>
+    void push(Pattern const &pattern, std::size_t arm)
+    {
+        if constexpr (IsSmallIntLiteral<Pattern>::value)
+        {
+            if constexpr (std::is_integral_v<Pattern>)
+            {
+                mLiterals[mSize] = static_cast<std::uint32_t>(+pattern);
+                mArms[mSize] = arm;
+                ++mSize;
+            }
+            else
+            {
+                std::apply([this, arm](auto const &...literals) { (push(literals, arm), ...); }, pattern.patterns());
+            }
+        }
+    }
+
+    alignas(16) std::array<std::uint32_t, kPADDED> mLiterals{};
+    std::array<std::size_t, kPADDED> mArms{};
+    std::size_t mSize = 0;
+};
+
+// Integral values matched against arms holding integral literals or or_ of them.
+// All literals are packed into one table and compared against the value with SIMD where available,
+// the lowest matching lane gives the first literal arm that matches.
+// Arms that are not literals (`_`, meet, app ...) are only tried if they come before that arm.
+// The table is built on each call, or once by a Matcher.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<isLiteralTableApplicableV<Value, Arms...> > >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+
+public:
+    using Table = LiteralTable<std::decay_t<Arms>...>;
+
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
+    {
+        return firstMatch(value, arms, Table{arms});
+    }
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms, Table const &table)
+    {
+        return firstMatchImpl(value, arms, table, std::index_sequence_for<Arms...>{});
+    }
+
+private:
+    template <std::size_t... A>
+    static std::size_t firstMatchImpl(Value const &value, ArmsTuple const &arms, Table const &table, std::index_sequence<A...>)
+    {
+        std::size_t const hit = table.lookup(static_cast<std::uint32_t>(+value));
+        std::size_t index = hit;
+        ((A < hit && matchOther(value, std::get<A>(arms)) && (index = A, true)) || ...);
+        return index;
+    }
+
+    template <typename Arm>
+    static bool matchOther(Value const &value, Arm const &arm)
+    {
+        if constexpr (isLiteralArmV<Arm>)
+        {
+            return false;
+        }
+        else
+        {
+            return arm.matchValue(value);
+        }
+    }
+};
+
+template <typename... Arms>
+class ArmsState<std::tuple<Arms...> >
+{
+public:
+    explicit ArmsState(std::tuple<Arms...> const &arms)
+        : mLiterals{arms}
+    {
+    }
+    LiteralTable<Arms...> const &literals() const
+    {
+        return mLiterals;
+    }
+
+private:
+    LiteralTable<Arms...> mLiterals;
+};
+
+template <typename Value, typename Arms>
+class IsLiteralTableApplicable : public std::false_type
+{
+};
+
+template <typename Value, typename... Arms>
+class IsLiteralTableApplicable<Value, std::tuple<Arms...> > : public std::bool_constant<isLiteralTableApplicableV<Value, Arms...> >
+{
+};
+
+template <typename Value, typename Arms, typename State>
+std::size_t firstMatchOf(Value const &value, Arms const &arms, State const *state)
+{
+    using Helper = ArmsMatchHelper<Value, Arms>;
+    if constexpr (IsLiteralTableApplicable<Value, Arms>::value)
+    {
+        if (state != nullptr)
+        {
+            return Helper::firstMatch(value, arms, state->literals());
+        }
+    }
+    return Helper::firstMatch(value, arms);
+}
+
+inline std::size_t lowestBit(std::uint64_t mask)
+{
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(mask));
+#else
+    std::size_t index = 0;
+    for (; (mask & 1U) == 0; mask >>= 1)
+    {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Set of values between two bounds, each bound being open or closed.
+template <typename Value>
+struct Interval
+{
+    Value low;
+    Value high;
+    bool lowClosed;
+    bool highClosed;
+
+    static Interval all()
+    {
+        using Limits = std::numeric_limits<Value>;
+        if constexpr (Limits::has_infinity)
+        {
+            return {-Limits::infinity(), Limits::infinity(), true, true};
+        }
+        else
+        {
+            return {Limits::lowest(), Limits::max(), true, true};
+        }
+    }
+    // Branch free on purpose, all arms are evaluated anyway.
+    bool contains(Value const &value) const
+    {
+        return ((value > low) | (lowClosed & (value == low))) & ((value < high) | (highClosed & (value == high)));
+    }
+    Interval intersect(Interval const &other) const
+    {
+        Interval result = *this;
+        if (other.low > low || (other.low == low && !other.lowClosed))
+        {
+            result.low = other.low;
+            result.lowClosed = other.lowClosed;
+        }
+        if (other.high < high || (other.high == high && !other.highClosed))
+        {
+            result.high = other.high;
+            result.highClosed = other.highClosed;
+        }
+        return result;
+    }
+};
+
+// Only bounds that convert to Value without changing the comparison results are accepted.
+template <typename Value, typename Bound, typename = void>
+inline constexpr bool isExactBoundV = false;
+
+template <typename Value, typename Bound>
+inline constexpr bool isExactBoundV<Value, Bound, std::enable_if_t<std::is_arithmetic_v<Bound> > > =
+    std::is_same_v<std::common_type_t<Value, Bound>, Value>;
+
+// Patterns that select an interval of an arithmetic Value.
+template <typename Value, typename Pattern>
+class IntervalTraits : public std::bool_constant<isExactBoundV<Value, Pattern> >
+{
+public:
+    static Interval<Value> interval(Pattern const &literal)
+    {
+        return {static_cast<Value>(literal), static_cast<Value>(literal), true, true};
+    }
+};
+
+template <typename Value, typename Op, typename T>
+class IntervalTraits<Value, Relation<Op, T> > : public std::bool_constant<isExactBoundV<Value, T> >
+{
+public:
+    static Interval<Value> interval(Relation<Op, T> const &relation)
+    {
+        auto result = Interval<Value>::all();
+        auto const bound = static_cast<Value>(relation.bound());
+        if constexpr (std::is_same_v<Op, std::less<> > || std::is_same_v<Op, std::less_equal<> >)
+        {
+            result.high = bound;
+            result.highClosed = std::is_same_v<Op, std::less_equal<> >;
+        }
+        else
+        {
+            result.low = bound;
+            result.lowClosed = std::is_same_v<Op, std::greater_equal<> >;
+        }
+        return result;
+    }
+};
+
+template <typename Value, typename T>
+class IntervalTraits<Value, Between<T> > : public std::bool_constant<isExactBoundV<Value, T> >
+{
+public:
+    static Interval<Value> interval(Between<T> const &range)
+    {
+        return {static_cast<Value>(range.low()), static_cast<Value>(range.high()), true, true};
+    }
+};
+
+template <typename Value, typename... Patterns>
+class IntervalTraits<Value, And<Patterns...> > : public std::bool_constant<(IntervalTraits<Value, Patterns>::value && ...)>
+{
+public:
+    static Interval<Value> interval(And<Patterns...> const &andPat)
+    {
+        return std::apply(
+            [](Patterns const &...patterns) {
+                auto result = Interval<Value>::all();
+                ((result = result.intersect(IntervalTraits<Value, Patterns>::interval(patterns))), ...);
+                return result;
+            },
+            andPat.patterns());
+    }
+};
+
+template <typename Value, typename Arm>
+inline constexpr bool isIntervalArmV = IntervalTraits<Value, ArmPatternT<Arm> >::value;
+
+template <typename Value, typename... Arms>
+inline constexpr bool isIntervalTableApplicableV = [] {
+    using V = std::decay_t<Value>;
+    if constexpr (std::is_arithmetic_v<V> && !std::is_same_v<V, bool> && sizeof...(Arms) <= 64)
+    {
+        constexpr bool isRange = ((isIntervalArmV<V, Arms> && !std::is_arithmetic_v<ArmPatternT<Arms> >) || ...);
+        return isRange && ((isIntervalArmV<V, Arms> || std::is_same_v<ArmPatternT<Arms>, WildCard>) && ...) &&
+               !isLiteralTableApplicableV<Value, Arms...>;
+    }
+    else
+    {
+        return false;
+    }
+}();
+
+// Arithmetic values matched against relational arms (`_ < 0`, `between(1, 5)`, `and_(_ < 17, _ > 15)`, literals and `_`).
+// Each arm is turned into an interval and all of them are tested without branches,
+// the lowest arm whose interval contains the value wins.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<isIntervalTableApplicableV<Value, Arms...> > >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    using V = std::decay_t<Value>;
+    using Mask = std::uint64_t;
+
+public:
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
+    {
+        return firstMatchImpl(value, arms, std::index_sequence_for<Arms...>{});
+    }
+
+private:
+    template <std::size_t... A>
+    static std::size_t firstMatchImpl(Value const &value, ArmsTuple const &arms, std::index_sequence<A...>)
+    {
+        Interval<V> const table[] = {armInterval(std::get<A>(arms).pattern())...};
+        Mask hits = 0;
+        ((hits |= Mask{std::is_same_v<ArmPatternT<Arms>, WildCard> || table[A].contains(value)} << A), ...);
+        return hits == 0 ? sizeof...(Arms) : lowestBit(hits);
+    }
+
+    template <typename Pattern>
+    static Interval<V> armInterval(Pattern const &pattern)
+    {
+        if constexpr (std::is_same_v<Pattern, WildCard>)
+        {
+            return Interval<V>::all();
+        }
+        else
+        {
+            return IntervalTraits<V, Pattern>::interval(pattern);
+        }
+    }
+};
+
+template <typename Pattern>
+class AltType
+{
+};
+
+template <typename T, typename Pattern>
+class AltType<Alt<T, Pattern> >
+{
+public:
+    using type = T;
+};
+
+template <typename Pattern, typename = std::void_t<> >
+struct IsAlt : std::false_type
+{
+};
+
+template <typename Pattern>
+struct IsAlt<Pattern, std::void_t<typename AltType<Pattern>::type> > : std::true_type
+{
+};
+
+template <typename Value, typename... Arms>
+class IsVariantTableApplicable : public std::false_type
+{
+};
+
+template <typename... Ts, typename... Arms>
+class IsVariantTableApplicable<std::variant<Ts...>, Arms...> : public std::bool_constant<(IsAlt<ArmPatternT<Arms> >::value || ...)>
+{
+};
+
+// std::variant values matched against `alt<T>(...)` arms.
+// A table generated from the arm list maps each alternative index to a function that only tries the arms
+// that can match that alternative: the `alt` arms naming it and the arms that are not `alt` patterns.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<IsVariantTableApplicable<std::decay_t<Value>, Arms...>::value> >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    using Variant = std::decay_t<Value>;
+    using Dispatch = std::size_t (*)(Value const &, ArmsTuple const &);
+    static constexpr std::size_t kVALUELESS = std::variant_size_v<Variant>;
+
+public:
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
+    {
+        static constexpr auto table = makeTable(std::make_index_sequence<kVALUELESS + 1>{});
+        std::size_t const index = value.valueless_by_exception() ? kVALUELESS : value.index();
+        return table[index](value, arms);
+    }
+
+private:
+    template <std::size_t... K>
+    static constexpr std::array<Dispatch, sizeof...(K)> makeTable(std::index_sequence<K...>)
+    {
+        return {&matchAlternative<K>...};
+    }
+
+    template <std::size_t K>
+    static std::size_t matchAlternative(Value const &value, ArmsTuple const &arms)
+    {
+        return matchAlternativeImpl<K>(value, arms, std::index_sequence_for<Arms...>{});
+    }
+
+    template <std::size_t K, std::size_t... A>
+    static std::size_t matchAlternativeImpl(Value const &value, ArmsTuple const &arms, std::index_sequence<A...>)
+    {
+        std::size_t index = sizeof...(Arms);
+        ((isCandidate<K, ArmPatternT<Arms> >() && std::get<A>(arms).matchValue(value) && (index = A, true)) || ...);
+        return index;
+    }
+
+    template <std::size_t K, typename Pattern>
+    static constexpr bool isCandidate()
+    {
+        if constexpr (IsAlt<Pattern>::value)
+        {
+            if constexpr (K == kVALUELESS)
+            {
+                return false;
+            }
+            else
+            {
+                return std::is_same_v<typename AltType<Pattern>::type, std::variant_alternative_t<K, Variant> >;
+            }
+        }
+        else
+        {
+            return true;
+        }
+    }
+};
+
+// Tries the arms set in a candidate mask, lowest first.
+template <typename Value, typename Arms>
+class MaskedArms;
+
+template <typename Value, typename... Arms>
+class MaskedArms<Value, std::tuple<Arms...> >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    using TryArm = bool (*)(Value const &, ArmsTuple const &);
+
+public:
+    using Mask = std::uint64_t;
+
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms, Mask candidates)
+    {
+        static constexpr auto tryArms = makeTryArms(std::index_sequence_for<Arms...>{});
+        for (; candidates != 0; candidates &= candidates - 1)
+        {
+            std::size_t const index = lowestBit(candidates);
+            if (tryArms[index](value, arms))
+            {
+                return index;
+            }
+        }
+        return sizeof...(Arms);
+    }
+
+private:
+    template <std::size_t... A>
+    static constexpr std::array<TryArm, sizeof...(A)> makeTryArms(std::index_sequence<A...>)
+    {
+        return {&tryArm<A>...};
+    }
+
+    template <std::size_t A>
+    static bool tryArm(Value const &value, ArmsTuple const &arms)
+    {
+        return std::get<A>(arms).matchValue(value);
+    }
+};
+
+template <typename Pattern>
+class IsDyn : public std::false_type
+{
+};
+
+template <typename T, typename Pattern>
+class IsDyn<Dyn<T, Pattern> > : public std::true_type
+{
+public:
+    template <typename Value>
+    static bool isConvertible(Value const &value)
+    {
+        return dynamic_cast<T const *>(&value) != nullptr;
+    }
+};
+
+template <typename Value, typename... Arms>
+inline constexpr bool isTypeTableApplicableV =
+    std::is_polymorphic_v<std::decay_t<Value> > && sizeof...(Arms) <= 64 && (IsDyn<ArmPatternT<Arms> >::value || ...);
+
+// Polymorphic values matched against `dyn<T>(...)` arms.
+// The arms a dynamic type can match (the `dyn` arms it converts to and all other arms) only depend on that type.
+// They are computed once per type, kept in a per match site hash table keyed by `typeid`,
+// and the last few types seen are kept in an inline cache in front of the table.
+// Both are thread local so no synchronization is needed.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<isTypeTableApplicableV<Value, Arms...> > >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    using Mask = typename MaskedArms<Value, ArmsTuple>::Mask;
+    static constexpr std::size_t kCACHE_SIZE = 4;
+
+    class CacheEntry
+    {
+    public:
+        std::type_info const *type = nullptr;
+        Mask candidates = 0;
+    };
+
+    class Site
+    {
+    public:
+        std::array<CacheEntry, kCACHE_SIZE> cache{};
+        std::size_t next = 0;
+        std::unordered_map<std::type_index, Mask> table;
+    };
+
+public:
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
+    {
+        return MaskedArms<Value, ArmsTuple>::firstMatch(value, arms, lookup(value, arms));
+    }
+
+private:
+    static Mask lookup(Value const &value, ArmsTuple const &arms)
+    {
+        thread_local Site site;
+        std::type_info const &type = typeid(value);
+        for (auto const &entry : site.cache)
+        {
+            if (entry.type != nullptr && *entry.type == type)
+            {
+                return entry.candidates;
+            }
+        }
+        auto iter = site.table.find(type);
+        if (iter == site.table.end())
+        {
+            iter = site.table.emplace(type, candidates(value, arms, std::index_sequence_for<Arms...>{})).first;
+        }
+        site.cache[site.next] = {&type, iter->second};
+        site.next = (site.next + 1) % kCACHE_SIZE;
+        return iter->second;
+    }
+
+    template <std::size_t... A>
+    static Mask candidates(Value const &value, ArmsTuple const &, std::index_sequence<A...>)
+    {
+        return ((Mask{isCandidate<ArmPatternT<Arms> >(value)} << A) | ...);
+    }
+
+    template <typename Pattern>
+    static bool isCandidate(Value const &value)
+    {
+        if constexpr (IsDyn<Pattern>::value)
+        {
+            return IsDyn<Pattern>::isConvertible(value);
+        }
+        else
+        {
+            return true;
+        }
+    }
+};
+
+template <typename Value, typename... Arms>
+inline constexpr bool isAnyTableApplicableV =
+    std::is_same_v<std::decay_t<Value>, std::any> && sizeof...(Arms) <= 64 && (IsAlt<ArmPatternT<Arms> >::value || ...);
+
+// std::any values matched against `alt<T>(...)` arms.
+// `type()` is read once and looked up in a static hash table built from the arm types,
+// giving the `alt` arms naming that type together with the arms that are not `alt` patterns.
+template <typename Value, typename... Arms>
+class ArmsMatchHelper<Value, std::tuple<Arms...>, std::enable_if_t<isAnyTableApplicableV<Value, Arms...> > >
+{
+    using ArmsTuple = std::tuple<Arms...>;
+    using Mask = typename MaskedArms<Value, ArmsTuple>::Mask;
+
+    class Table
+    {
+    public:
+        Table()
+        {
+            addArms(std::index_sequence_for<Arms...>{});
+        }
+        Mask candidates(std::type_info const &type) const
+        {
+            auto const iter = mAltArms.find(type);
+            return mOtherArms | (iter == mAltArms.end() ? 0 : iter->second);
+        }
+
+    private:
+        template <std::size_t... A>
+        void addArms(std::index_sequence<A...>)
+        {
+            (addArm<A, ArmPatternT<Arms> >(), ...);
+        }
+        template <std::size_t A, typename Pattern>
+        void addArm()
+        {
+            if constexpr (IsAlt<Pattern>::value)
+            {
+                mAltArms[typeid(typename AltType<Pattern>::type)] |= Mask{1} << A;
+            }
+            else
+            {
+                mOtherArms |= Mask{1} << A;
+            }
         }
-    } // namespace detail
 
-    template <class F, class Tuple>
-    constexpr auto apply(F &&f, Tuple &&t)
-    -> decltype(
-    detail::apply_impl(
-        std::forward<F>(f), std::forward<Tuple>(t),
-        std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple> > >{}))
+        std::unordered_map<std::type_index, Mask> mAltArms;
+        Mask mOtherArms = 0;
+    };
+
+public:
+    static std::size_t firstMatch(Value const &value, ArmsTuple const &arms)
     {
-        return detail::apply_impl(
-            std::forward<F>(f), std::forward<Tuple>(t),
-            std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple> > >{});
+        static Table const table;
+        return MaskedArms<Value, ArmsTuple>::firstMatch(value, arms, table.candidates(value.type()));
     }
-}
-
-template <typename Value, typename Pattern, typename = std::void_t<> >
-struct MatchFuncDefined : std::false_type
-{
 };
 
-template <typename Value, typename Pattern>
-struct MatchFuncDefined<Value, Pattern, std::void_t<decltype(::matchPattern(std::declval<Value>(), std::declval<Pattern>()))> >
-    : std::true_type
+// Types of the identifiers in a pattern, in order, with repetitions, and whether these are all of them.
+// A pattern with traits of its own may hold identifiers, so unless it specializes IdsOf it is never taken
+// for identifier-free: its bindings are undone on failure, only without a frame slot.
+template <typename Pattern>
+class IdsOf
 {
+public:
+    using type = std::tuple<>;
+    static constexpr bool kKNOWN = isEqualityPatternV<Pattern>;
 };
 
-template <typename Value, typename Pattern>
-inline constexpr bool MatchFuncDefinedV = MatchFuncDefined<Value, Pattern>::value;
+template <typename... Patterns>
+using IdsOfT = decltype(std::tuple_cat(std::declval<typename IdsOf<Patterns>::type>()...));
 
-using std::get;
-template <std::size_t N, typename Tuple>
-auto drop(Tuple &&t);
+template <typename... Patterns>
+inline constexpr bool idsKnownV = (IdsOf<Patterns>::kKNOWN && ...);
 
-template <typename ValuesTuple, typename PatternsTuple>
-bool tryOooMatch(ValuesTuple const &values, PatternsTuple const &patterns);
+class NoIds
+{
+public:
+    using type = std::tuple<>;
+    static constexpr bool kKNOWN = true;
+};
 
+template <>
+class IdsOf<WildCard> : public NoIds
+{
+};
 
-template <typename Pattern>
-class IsOoo;
+template <typename Pred>
+class IdsOf<Meet<Pred> > : public NoIds
+{
+};
 
-template <typename Pattern>
-inline constexpr bool isOooV = IsOoo<std::decay_t<Pattern> >::value;
+template <typename Op, typename T>
+class IdsOf<Relation<Op, T> > : public NoIds
+{
+};
 
-template <typename ValuesTuple, typename PatternsTuple, typename Enable = void> 
-class TupleMatchHelper
+template <typename T>
+class IdsOf<Between<T> > : public NoIds
 {
-    template <typename VT = ValuesTuple>
-    static bool tupleMatchImpl(VT const &values, PatternsTuple const &patterns) = delete;
 };
 
-template <typename ValuesTuple, typename PatternHead, typename... PatternTail>
-class TupleMatchHelper<ValuesTuple, std::tuple<PatternHead, PatternTail...>, std::enable_if_t<!isOooV<PatternHead>>>
+template <typename Type, bool own>
+class IdsOf<Id<Type, own> >
 {
 public:
-    template <typename VT = ValuesTuple>
-static auto tupleMatchImpl(VT const &values, std::tuple<PatternHead, PatternTail...> const &patterns)
--> decltype(::matchPattern(get<0>(values), get<0>(patterns)) && TupleMatchHelper<decltype(drop<1>(values)), decltype(drop<1>(patterns))>::tupleMatchImpl(drop<1>(values), drop<1>(patterns)))
-{
-    return ::matchPattern(get<0>(values), get<0>(patterns)) && TupleMatchHelper<decltype(drop<1>(values)), decltype(drop<1>(patterns))>::tupleMatchImpl(drop<1>(values), drop<1>(patterns));
-}
+    using type = std::tuple<Id<Type, own> >;
+    static constexpr bool kKNOWN = true;
 };
 
-template <typename PatternHead, typename... PatternTail>
-class TupleMatchHelper<std::tuple<>, std::tuple<PatternHead, PatternTail...>, std::enable_if_t<!isOooV<PatternHead> >>
+template <typename... Patterns>
+class IdsOf<Or<Patterns...> >
 {
 public:
-    template <typename VT = std::tuple<>>
-    static bool tupleMatchImpl(VT const &values, std::tuple<PatternHead, PatternTail...> const &patterns) = delete;
+    using type = IdsOfT<Patterns...>;
+    static constexpr bool kKNOWN = idsKnownV<Patterns...>;
 };
 
+template <typename... Patterns>
+class IdsOf<And<Patterns...> >
+{
+public:
+    using type = IdsOfT<Patterns...>;
+    static constexpr bool kKNOWN = idsKnownV<Patterns...>;
+};
 
-template <typename ValuesTuple>
-class TupleMatchHelper<ValuesTuple, std::tuple<>>
+template <typename... Patterns>
+class IdsOf<Ds<Patterns...> >
 {
 public:
-    template <typename VT = std::tuple<>>
-static auto tupleMatchImpl(VT const &values, std::tuple<>)
+    using type = IdsOfT<Patterns...>;
+    static constexpr bool kKNOWN = idsKnownV<Patterns...>;
+};
+
+template <typename Unary, typename Pattern>
+class IdsOf<App<Unary, Pattern> >
 {
-    return false;
-}
+public:
+    using type = IdsOfT<Pattern>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern>;
 };
 
-template <typename ValuesTuple, typename PatternHead, typename... PatternTail>
-class TupleMatchHelper<ValuesTuple, std::tuple<PatternHead, PatternTail...>, std::enable_if_t<isOooV<PatternHead> >>
+template <typename Pattern>
+class IdsOf<Not<Pattern> >
 {
 public:
-    template <typename VT = std::tuple<>>
-static auto tupleMatchImpl(VT const &values, std::tuple<PatternHead, PatternTail...> const &patterns)
--> decltype(tryOooMatch(values, patterns))
+    using type = IdsOfT<Pattern>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern>;
+};
+
+template <typename Pattern, std::size_t minSize, std::size_t maxSize, typename Length, SegmentMode mode>
+class IdsOf<Ooo<Pattern, minSize, maxSize, Length, mode> >
 {
-    return tryOooMatch(values, patterns);
-}
+public:
+    using type = IdsOfT<Pattern, Length>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern, Length>;
 };
 
-template <>
-class TupleMatchHelper<std::tuple<>, std::tuple<>>
+template <typename Pattern, typename Pred>
+class IdsOf<PostCheck<Pattern, Pred> >
 {
 public:
-    template <typename VT = std::tuple<>>
-static auto tupleMatchImpl(VT, std::tuple<>)
+    using type = IdsOfT<Pattern>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern>;
+};
+
+template <typename T, typename Pattern>
+class IdsOf<Alt<T, Pattern> >
 {
-    return true;
-}
+public:
+    using type = IdsOfT<Pattern>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern>;
 };
 
-template <typename... Patterns>
-class PatternTraits<Ds<Patterns...> >
+template <typename T, typename Pattern>
+class IdsOf<Dyn<T, Pattern> >
 {
 public:
-    template <typename Tuple>
-    static auto matchPatternImpl(Tuple const &valueTuple, Ds<Patterns...> const &dsPat)
-        -> decltype(TupleMatchHelper<Tuple, std::tuple<Patterns...>>::tupleMatchImpl(valueTuple, dsPat.patterns()))
-    {
-        return TupleMatchHelper<Tuple, std::tuple<Patterns...>>::tupleMatchImpl(valueTuple, dsPat.patterns());
-    }
-    static void resetId(Ds<Patterns...> const &dsPat)
-    {
-        return std::apply(
-            [](Patterns const &...patterns) {
-                return (::resetId(patterns), ...);
-            },
-            dsPat.patterns());
-    }
+    using type = IdsOfT<Pattern>;
+    static constexpr bool kKNOWN = idsKnownV<Pattern>;
+};
 
-private:
+template <typename... Ids>
+class CopiesBindings<std::tuple<Ids...> > : public std::bool_constant<(Ids::kCOPIES && ...)>
+{
 };
 
-template <typename Pattern>
-class Ooo;
+template <typename PatternsTuple, std::size_t... I>
+class IsIdFree<PatternsTuple, std::index_sequence<I...> >
+    : public std::bool_constant<std::tuple_size_v<IdsOfT<std::tuple_element_t<I, PatternsTuple>...> > == 0 &&
+                                idsKnownV<std::tuple_element_t<I, PatternsTuple>...> >
+{
+};
 
-template <typename Pattern>
-class IsOoo : public std::false_type
+template <typename Type, typename... Types>
+inline constexpr std::size_t countTypeV = (std::is_same_v<Type, Types> + ... + 0);
+
+template <typename Types>
+class HasRepeatedTypes;
+
+template <typename... Types>
+class HasRepeatedTypes<std::tuple<Types...> > : public std::bool_constant<((countTypeV<Types, Types...> > 1) || ...)>
 {
 };
 
-template <typename Pattern>
-class IsOoo<Ooo<Pattern> > : public std::true_type
+template <typename Value>
+class MatchCases : public std::integral_constant<std::size_t, 1>
 {
 };
 
-static_assert(isOooV<Ooo<int> > == true);
-static_assert(isOooV<Ooo<int &> > == true);
-static_assert(isOooV<Ooo<int const &> > == true);
-static_assert(isOooV<Ooo<int &&> > == true);
-static_assert(isOooV<int> == false);
-static_assert(isOooV<const Ooo<WildCard> &> == true);
+template <typename... Ts>
+class MatchCases<std::variant<Ts...> > : public std::integral_constant<std::size_t, sizeof...(Ts)>
+{
+};
 
-template <typename Tuple, std::size_t... I>
-auto takeImpl(Tuple &&t, std::index_sequence<I...>)
+// Which cases of Value a pattern always matches, as a bit mask.
+// A std::variant has one case per alternative, any other value a single one.
+// Patterns whose result depends on runtime values (literals, relations, meet, not_, when ...) cover nothing.
+template <typename Value, typename Pattern, typename Enable = void>
+class Coverage
 {
-    using std::get;
-    return std::forward_as_tuple(get<I>(std::forward<Tuple>(t))...);
-}
+public:
+    static constexpr std::uint64_t mask = 0;
+};
 
-template <std::size_t N, typename Tuple>
-auto take(Tuple &&t)
+template <typename Value>
+inline constexpr std::uint64_t allCasesV = (std::uint64_t{1} << MatchCases<Value>::value) - 1;
+
+template <typename Value, typename Pattern>
+inline constexpr bool isIrrefutableV = Coverage<std::decay_t<Value>, Pattern>::mask == allCasesV<std::decay_t<Value> >;
+
+template <typename Value>
+class Coverage<Value, WildCard>
 {
-    return takeImpl(
-        std::forward<Tuple>(t),
-        std::make_index_sequence<N>{});
-}
+public:
+    static constexpr std::uint64_t mask = allCasesV<Value>;
+};
 
-template <std::size_t N, typename Tuple, std::size_t... I>
-auto dropImpl(Tuple &&t, std::index_sequence<I...>)
+template <typename Value, typename Type, bool own>
+class Coverage<Value, Id<Type, own>, std::enable_if_t<MatchFuncDefinedV<Value, Id<Type, own> > > >
 {
-    using std::get;
-    // Fixme, use std::forward_as_tuple when possible.
-    // return std::forward_as_tuple(get<I + N>(std::forward<Tuple>(t))...);
-    return std::make_tuple(get<I + N>(std::forward<Tuple>(t))...);
-}
+public:
+    static constexpr std::uint64_t mask = allCasesV<Value>;
+};
 
-template <std::size_t N, typename Tuple>
-auto drop(Tuple &&t)
+template <typename Value, typename... Patterns>
+class Coverage<Value, Or<Patterns...> >
 {
-    return dropImpl<N>(
-        std::forward<Tuple>(t),
-        std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple> > - N>{});
-}
+public:
+    static constexpr std::uint64_t mask = (Coverage<Value, Patterns>::mask | ... | 0);
+};
 
-template <typename ValuesTuple, typename PatternsTuple>
-bool tryOooMatch(ValuesTuple const &values, PatternsTuple const &patterns)
+template <typename Value, typename... Patterns>
+class Coverage<Value, And<Patterns...> >
 {
-    if constexpr (std::tuple_size_v<PatternsTuple> == 0)
-    {
-        return std::tuple_size_v<ValuesTuple> == 0;
-    }
-    else if constexpr (isOooV<std::tuple_element_t<0, PatternsTuple> >)
-    {
-        auto index = std::make_index_sequence<std::tuple_size_v<ValuesTuple> + 1>{};
-        return tryOooMatchImpl(values, patterns, index);
-    }
-    else if constexpr (std::tuple_size_v<ValuesTuple> >= 1)
-    {
-        if constexpr (MatchFuncDefinedV<std::tuple_element_t<0, ValuesTuple>, std::tuple_element_t<0, PatternsTuple> >)
-        {
-            return ::matchPattern(std::get<0>(values), std::get<0>(patterns)) && tryOooMatch(drop<1>(values), drop<1>(patterns));
-        }
-    }
-    return false;
-}
+public:
+    static constexpr std::uint64_t mask = (Coverage<Value, Patterns>::mask & ... & allCasesV<Value>);
+};
 
-class OooMatchBreak : public std::exception
+template <typename Value, typename Unary, typename Pattern>
+class Coverage<Value, App<Unary, Pattern>, std::enable_if_t<std::is_invocable_v<Unary const &, Value const &> > >
 {
+public:
+    static constexpr std::uint64_t mask = isIrrefutableV<std::invoke_result_t<Unary const &, Value const &>, Pattern> ? allCasesV<Value> : 0;
 };
 
-template < std::size_t I, typename ValuesTuple, typename PatternsTuple>
-bool tryOooMatchImplHelper(ValuesTuple const &values, PatternsTuple const &patterns)
+template <typename T, typename Pattern, typename... Ts>
+class Coverage<std::variant<Ts...>, Alt<T, Pattern> >
 {
-    using std::get;
-    if constexpr (I == 0)
+    template <std::size_t... K>
+    static constexpr std::uint64_t maskImpl(std::index_sequence<K...>)
     {
-        return (tryOooMatch(values, drop<1>(patterns)));
+        return ((std::is_same_v<T, Ts> ? std::uint64_t{1} << K : 0) | ... | 0);
     }
-    else if constexpr (I > 0)
-    {
-        if constexpr (MatchFuncDefinedV<decltype(take<I>(values)), std::tuple_element_t<0, PatternsTuple> >)
-        {
-            if (!PatternTraits<std::tuple_element_t<0, PatternsTuple> >::matchPatternImplSingle(get<I - 1>(values), get<0>(patterns)))
-            {
-                throw OooMatchBreak();
-            }
 
-            if (!tryOooMatch(drop<I>(values), drop<1>(patterns)))
-            {
-                return false;
-            }
-            return true;
-        }
-    }
-    throw OooMatchBreak();
-}
+public:
+    static constexpr std::uint64_t mask = isIrrefutableV<T, Pattern> ? maskImpl(std::index_sequence_for<Ts...>{}) : 0;
+};
 
-template <typename ValuesTuple, typename PatternsTuple, std::size_t... I>
-bool tryOooMatchImpl(ValuesTuple const &values, PatternsTuple const &patterns, std::index_sequence<I...>)
+template <typename Value, typename... Patterns>
+class Coverage<Value, Ds<Patterns...>, std::enable_if_t<isTupleLikeV<Value> > >
 {
-    try
-    {
-        return ((tryOooMatchImplHelper<I>(values, patterns)) || ...);
-    }
-    catch (const OooMatchBreak &)
-    {
-        return false;
-    }
-}
+    static constexpr std::size_t kSIZE = std::tuple_size_v<Value>;
+    static constexpr std::size_t kFIXED = ((isOooV<Patterns> ? 0 : 1) + ... + 0);
+    static constexpr bool kHAS_OOO = (isOooV<Patterns> || ...);
 
-template <typename Pattern>
-class Ooo
-{
-public:
-    explicit Ooo(Pattern const &pattern)
-        : mPattern{pattern}
-    {
-    }
-    auto const &pattern() const
+    template <std::size_t... I>
+    static constexpr bool isIrrefutable(std::index_sequence<I...>)
     {
-        return mPattern;
+        if constexpr (!kHAS_OOO && kSIZE == sizeof...(Patterns))
+        {
+            return (isIrrefutableV<decltype(get<I>(std::declval<Value const &>())), std::tuple_element_t<I, std::tuple<Patterns...> > > && ...);
+        }
+        else
+        {
+            // Segments can take elements of any type, only wildcards are known to accept all of them.
+            return kHAS_OOO && kSIZE >= kFIXED && ((std::is_same_v<Patterns, WildCard> || std::is_same_v<Patterns, Ooo<WildCard> >) && ...);
+        }
     }
 
-private:
-    Pattern mPattern;
+public:
+    static constexpr std::uint64_t mask = isIrrefutable(std::index_sequence_for<Patterns...>{}) ? allCasesV<Value> : 0;
 };
 
-template <typename Pattern>
-auto ooo(Pattern const &pattern)
-{
-    return Ooo<Pattern>{pattern};
-}
+// An arm repeating an identifier type may compare two bindings, so it is not trusted to cover anything.
+template <typename Value, typename Arm>
+inline constexpr std::uint64_t armCoverageV =
+    HasRepeatedTypes<typename IdsOf<ArmPatternT<Arm> >::type>::value
+        ? 0
+        : Coverage<std::decay_t<Value>, ArmPatternT<Arm> >::mask;
 
-template <typename Pattern>
-class PatternTraits<Ooo<Pattern> >
+template <typename Value, typename... Arms>
+class Exhaustiveness<Value, std::tuple<Arms...> >
+    : public std::bool_constant<(armCoverageV<Value, Arms> | ... | 0) == allCasesV<std::decay_t<Value> > >
 {
-public:
-    template <typename... Values>
-    static auto matchPatternImpl(std::tuple<Values...> const &valueTuple, Ooo<Pattern> const &oooPat)
-    -> decltype((::matchPattern(std::declval<Values>(), oooPat.pattern()) && ...))
-    {
-        return std::apply(
-            [&oooPat](Values const &...values) {
-                auto result = (::matchPattern(values, oooPat.pattern()) && ...);
-                return result;
-            },
-            valueTuple);
-    }
-    template <typename Value>
-    static auto matchPatternImplSingle(Value const &value, Ooo<Pattern> const &oooPat)
-    -> decltype(::matchPattern(value, oooPat.pattern()))
-    {
-        return ::matchPattern(value, oooPat.pattern());
-    }
-    static void resetId(Ooo<Pattern> const &oooPat)
-    {
-        ::resetId(oooPat.pattern());
-    }
 };
 
-template <typename Pattern, typename Pred>
-class PostCheck
+template <typename Ids>
+class FrameStorage;
+
+template <typename... Ids>
+class FrameStorage<std::tuple<Ids...> >
 {
 public:
-    explicit PostCheck(Pattern const &pattern, Pred const &pred)
-        : mPattern{pattern}, mPred{pred}
-    {
-    }
-    bool check() const
-    {
-        return mPred();
-    }
-    auto const &pattern() const
-    {
-        return mPattern;
-    }
-
-private:
-    Pattern const mPattern;
-    Pred const mPred;
+    using type = std::tuple<typename Ids::StorageT...>;
 };
 
-template <typename Pattern, typename Pred>
-class PatternTraits<PostCheck<Pattern, Pred> >
+// One slot for every identifier appearing in the arms. An identifier used twice gets two slots and only claims one.
+template <typename... Arms>
+class BindingFrame<std::tuple<Arms...> >
 {
+    using Ids = IdsOfT<ArmPatternT<Arms>...>;
+    using Storage = typename FrameStorage<Ids>::type;
+    static constexpr std::size_t kSIZE = std::tuple_size_v<Ids>;
+
 public:
-    template <typename Value>
-    static auto matchPatternImpl(Value const &value, PostCheck<Pattern, Pred> const &postCheck)
-    -> decltype(::matchPattern(value, postCheck.pattern()) && postCheck.check())
+    // Set while the arm is selected. Arms binding nothing do not touch the trail at all.
+    using Trail = std::conditional_t<IsIdFree<std::tuple<ArmPatternT<Arms>...> >::value, std::tuple<>, BindingTrail::Scope>;
+
+    explicit BindingFrame(Arms const &...arms)
+        : mSlots{makeSlots(mStorage, std::make_index_sequence<kSIZE>{})}
+        , mFrame{mSlots.data(), mSlots.data() + kSIZE}
     {
-        return ::matchPattern(value, postCheck.pattern()) && postCheck.check();
+        if constexpr (kSIZE > 0)
+        {
+            mFrame.reserve([&arms...] { (::resetId(arms.pattern()), ...); });
+        }
     }
-    static void resetId(PostCheck<Pattern, Pred> const &postCheck)
+
+private:
+    template <std::size_t... I>
+    static std::array<MatchFrame::Slot, kSIZE> makeSlots(Storage &storage, std::index_sequence<I...>)
     {
-        ::resetId(postCheck.pattern());
+        return {MatchFrame::Slot{nullptr, &kStorageTag<std::tuple_element_t<I, Storage> >, &std::get<I>(storage)}...};
     }
+
+    Storage mStorage;
+    std::array<MatchFrame::Slot, kSIZE> mSlots;
+    MatchFrame mFrame;
 };
 
 // TODO fix the two assertion compilations.